@@ -0,0 +1,138 @@
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "komendy.hpp"
+
+namespace {
+struct Kontekst {
+  size_t suma = 0;
+};
+
+void zlicz(Kontekst& kontekst, std::string_view argumenty) {
+  kontekst.suma += argumenty.size() + 1;
+}
+
+void zlicz_tokeny(Kontekst& kontekst, std::string_view argumenty) {
+  std::string_view pierwszy = komendy::nastepny_token(&argumenty);
+  std::string_view drugi = komendy::nastepny_token(&argumenty);
+  kontekst.suma += pierwszy.size() + drugi.size() + 1;
+}
+
+void zlicz_prywatna(Kontekst& kontekst, std::string_view argumenty) {
+  std::string_view odbiorca = komendy::nastepny_token(&argumenty);
+  kontekst.suma += odbiorca.size() + komendy::przytnij(argumenty).size() + 1;
+}
+
+using DyspozytorTestowy = komendy::Dyspozytor<Kontekst>;
+
+constexpr std::array<DyspozytorTestowy::Wpis, 8> kKomendy = {{
+    {"name", zlicz},
+    {"msg", zlicz_prywatna},
+    {"rooms", zlicz},
+    {"stats", zlicz},
+    {"create", zlicz_tokeny},
+    {"join", zlicz_tokeny},
+    {"delete", zlicz_tokeny},
+    {"leave", zlicz},
+}};
+
+std::string przytnij_kopia(const std::string& tekst) {
+  size_t start = tekst.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) {
+    return "";
+  }
+  size_t koniec = tekst.find_last_not_of(" \t\r\n");
+  return tekst.substr(start, koniec - start + 1);
+}
+
+void dopasuj_lancuchem(Kontekst& kontekst, const std::string& linia) {
+  if (linia.rfind("/name ", 0) == 0) {
+    kontekst.suma += przytnij_kopia(linia.substr(6)).size() + 1;
+    return;
+  }
+  if (linia.rfind("/msg ", 0) == 0) {
+    std::istringstream strumien(linia);
+    std::string token;
+    std::string odbiorca;
+    std::string wiadomosc;
+    strumien >> token >> odbiorca;
+    std::getline(strumien, wiadomosc);
+    kontekst.suma += odbiorca.size() + przytnij_kopia(wiadomosc).size() + 1;
+    return;
+  }
+  if (linia == "/rooms" || linia == "/stats" || linia == "/leave") {
+    kontekst.suma += 1;
+    return;
+  }
+  const std::array<std::pair<const char*, size_t>, 3> z_argumentami = {{
+      {"/create ", 8}, {"/join ", 6}, {"/delete ", 8}}};
+  for (const auto& [prefiks, dlugosc] : z_argumentami) {
+    if (linia.rfind(prefiks, 0) == 0) {
+      std::istringstream strumien(linia.substr(dlugosc));
+      std::string pierwszy;
+      std::string drugi;
+      strumien >> pierwszy >> drugi;
+      kontekst.suma += pierwszy.size() + drugi.size() + 1;
+      return;
+    }
+  }
+}
+
+template <typename Funkcja>
+double zmierz_ns(size_t powtorzenia, Funkcja&& funkcja) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < powtorzenia; ++i) {
+    funkcja();
+  }
+  auto czas = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(czas).count() / static_cast<double>(powtorzenia);
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  size_t powtorzenia = 1000000;
+  if (liczba_argumentow > 1) {
+    powtorzenia = std::strtoull(argumenty[1], nullptr, 10);
+    if (powtorzenia == 0) {
+      std::cerr << "Użycie: " << argumenty[0] << " [powtórzenia]\n";
+      return 1;
+    }
+  }
+
+  const std::array<std::string, 9> linie = {
+      "/name   nowy_nick  ",
+      "/msg alicja czy widzisz tę wiadomość?",
+      "/rooms",
+      "/stats",
+      "/create pokoj_testowy tajne",
+      "/join pokoj_testowy tajne",
+      "/delete pokoj_testowy",
+      "/leave",
+      "zwykła wiadomość na czacie",
+  };
+
+  DyspozytorTestowy dyspozytor(kKomendy);
+  Kontekst przed;
+  Kontekst po;
+
+  std::cout << std::left << std::setw(44) << "linia" << std::right << std::setw(14)
+            << "przed [ns]" << std::setw(14) << "po [ns]" << "\n";
+  for (const std::string& linia : linie) {
+    double czas_przed = zmierz_ns(powtorzenia, [&] { dopasuj_lancuchem(przed, linia); });
+    double czas_po = zmierz_ns(powtorzenia, [&] { dyspozytor.wykonaj(po, linia); });
+    std::cout << std::left << std::setw(44) << linia << std::right
+              << std::fixed << std::setprecision(1) << std::setw(14) << czas_przed
+              << std::setw(14) << czas_po << "\n";
+  }
+  if (przed.suma != po.suma) {
+    std::cerr << "Niezgodne wyniki parsowania: " << przed.suma << " != " << po.suma << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "magazyn.hpp"
+
+namespace {
+constexpr uint32_t kPokoje = 3;
+
+void usun_katalog(const std::string& katalog) {
+  if (DIR* wpisy = opendir(katalog.c_str())) {
+    while (dirent* wpis = readdir(wpisy)) {
+      std::string nazwa = wpis->d_name;
+      if (nazwa != "." && nazwa != "..") {
+        ::unlink((katalog + "/" + nazwa).c_str());
+      }
+    }
+    closedir(wpisy);
+  }
+  ::rmdir(katalog.c_str());
+}
+
+size_t oczekiwane(int64_t od_us, int64_t do_us, uint32_t id_pokoju) {
+  size_t liczba = 0;
+  for (int64_t czas = od_us; czas <= do_us; ++czas) {
+    if (id_pokoju == 0 || static_cast<uint32_t>(czas % kPokoje) + 1 == id_pokoju) {
+      ++liczba;
+    }
+  }
+  return liczba;
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  int64_t rekordy = 7000;
+  if (liczba_argumentow > 1) {
+    rekordy = std::strtoll(argumenty[1], nullptr, 10);
+    if (rekordy <= 0) {
+      std::cerr << "Użycie: " << argumenty[0] << " [rekordy]\n";
+      return 1;
+    }
+  }
+  char szablon[] = "/tmp/chat_bench_magazyn.XXXXXX";
+  if (!mkdtemp(szablon)) {
+    std::cerr << "Nie można utworzyć katalogu tymczasowego.\n";
+    return 1;
+  }
+  std::string katalog = szablon;
+  bool poprawny = true;
+  {
+    magazyn::Magazyn magazyn;
+    if (!magazyn.otworz(katalog, magazyn::kMinimalnyRozmiarSegmentu, false)) {
+      std::cerr << "Nie można otworzyć magazynu: " << katalog << "\n";
+      usun_katalog(katalog);
+      return 1;
+    }
+    std::string tresc(200, 'x');
+    for (int64_t czas = 1; czas <= rekordy; ++czas) {
+      magazyn::Rekord rekord;
+      rekord.typ = magazyn::TypRekordu::WiadomoscPokoju;
+      rekord.czas_us = czas;
+      rekord.id_pokoju = static_cast<uint32_t>(czas % kPokoje) + 1;
+      rekord.tresc = tresc;
+      magazyn.dopisz(rekord);
+    }
+
+    size_t zapytania = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t id_pokoju = 0; id_pokoju <= kPokoje; ++id_pokoju) {
+      for (int64_t od_us = 0; od_us <= rekordy + 1; ++od_us) {
+        int64_t do_us = od_us + rekordy / 4;
+        size_t znalezione = 0;
+        magazyn.przegladaj(od_us, do_us, id_pokoju,
+                           [&](const magazyn::Rekord&) { ++znalezione; });
+        ++zapytania;
+        size_t spodziewane = oczekiwane(std::max<int64_t>(od_us, 1),
+                                        std::min(do_us, rekordy), id_pokoju);
+        if (znalezione != spodziewane) {
+          std::cerr << "Zakres od " << od_us << " do " << do_us << " w pokoju " << id_pokoju
+                    << ": " << znalezione << " rekordów zamiast " << spodziewane << ".\n";
+          poprawny = false;
+        }
+      }
+    }
+    auto czas = std::chrono::steady_clock::now() - start;
+    std::cout << std::fixed << std::setprecision(2) << "przeglądanie zakresu: "
+              << std::chrono::duration<double, std::micro>(czas).count() /
+                     static_cast<double>(zapytania)
+              << " us na zapytanie (" << zapytania << " zapytań)\n";
+  }
+  usun_katalog(katalog);
+  return poprawny ? 0 : 1;
+}
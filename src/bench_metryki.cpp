@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metryki.hpp"
+
+namespace {
+template <typename Funkcja>
+double zmierz_ns(size_t watki, size_t powtorzenia, Funkcja&& funkcja) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pula;
+  for (size_t w = 0; w < watki; ++w) {
+    pula.emplace_back([&] {
+      for (size_t i = 0; i < powtorzenia; ++i) {
+        funkcja(i);
+      }
+    });
+  }
+  for (std::thread& watek : pula) {
+    watek.join();
+  }
+  auto czas = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(czas).count() / static_cast<double>(powtorzenia);
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  size_t powtorzenia = 10000000;
+  if (liczba_argumentow > 1) {
+    powtorzenia = std::strtoull(argumenty[1], nullptr, 10);
+    if (powtorzenia == 0) {
+      std::cerr << "Użycie: " << argumenty[0] << " [powtórzenia]\n";
+      return 1;
+    }
+  }
+  size_t maks_watkow = std::max(1u, std::thread::hardware_concurrency());
+
+  std::cout << std::left << std::setw(12) << "wątki" << std::right << std::setw(18)
+            << "licznik [ns]" << std::setw(18) << "histogram [ns]" << "\n";
+  for (size_t watki = 1; watki <= maks_watkow; watki *= 2) {
+    metryki::Licznik licznik;
+    metryki::Histogram histogram;
+    double czas_licznika = zmierz_ns(watki, powtorzenia, [&](size_t) { licznik.dodaj(); });
+    double czas_histogramu =
+        zmierz_ns(watki, powtorzenia, [&](size_t i) { histogram.zapisz(i & 0xffff); });
+    std::cout << std::left << std::setw(12) << watki << std::right << std::fixed
+              << std::setprecision(2) << std::setw(18) << czas_licznika << std::setw(18)
+              << czas_histogramu << "\n";
+    if (licznik.wartosc() != watki * powtorzenia ||
+        histogram.stan().liczba != watki * powtorzenia) {
+      std::cerr << "Zgubione aktualizacje metryk.\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,308 @@
+#ifndef CHATAPP_BLOKADY_HPP
+#define CHATAPP_BLOKADY_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metryki.hpp"
+
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define CHATAPP_MIEJSCE_WYWOLANIA __builtin_FUNCTION()
+#else
+#define CHATAPP_MIEJSCE_WYWOLANIA "?"
+#endif
+
+namespace blokady {
+
+#ifdef CHATAPP_PROFILOWANIE_BLOKAD
+constexpr bool kProfilowanieWkompilowane = true;
+#else
+constexpr bool kProfilowanieWkompilowane = false;
+#endif
+
+constexpr size_t kLiczbaMiejsc = 32;
+
+using Chwila = std::chrono::steady_clock::time_point;
+
+inline std::atomic<bool>& flaga_profilowania() {
+  static std::atomic<bool> wlaczone{false};
+  return wlaczone;
+}
+
+inline bool profilowanie_wlaczone() {
+  return kProfilowanieWkompilowane && flaga_profilowania().load(std::memory_order_relaxed);
+}
+
+inline uint64_t nanosekundy(Chwila od, Chwila do_) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(do_ - od).count());
+}
+
+class Profil;
+
+inline std::vector<Profil*>& profile() {
+  static std::vector<Profil*> wszystkie;
+  return wszystkie;
+}
+
+inline std::mutex& mutex_profili() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+class Profil {
+ public:
+  struct Miejsce {
+    std::atomic<const char*> nazwa{nullptr};
+    std::atomic<uint64_t> nabycia{0};
+    std::atomic<uint64_t> oczekiwanie_ns{0};
+  };
+
+  explicit Profil(const char* nazwa, metryki::Histogram* oczekiwanie = nullptr)
+      : nazwa_(nazwa), metryka_oczekiwania_(oczekiwanie) {
+    std::lock_guard<std::mutex> blokada(mutex_profili());
+    profile().push_back(this);
+  }
+
+  ~Profil() {
+    std::lock_guard<std::mutex> blokada(mutex_profili());
+    auto& wszystkie = profile();
+    wszystkie.erase(std::remove(wszystkie.begin(), wszystkie.end(), this), wszystkie.end());
+  }
+
+  Profil(const Profil&) = delete;
+  Profil& operator=(const Profil&) = delete;
+
+  void zapisz_rywalizacje(uint64_t oczekiwanie_ns) {
+    if (metryka_oczekiwania_) {
+      metryka_oczekiwania_->zapisz(oczekiwanie_ns);
+    }
+  }
+
+  void zapisz_nabycie(const char* miejsce, uint64_t oczekiwanie_ns, bool rywalizacja) {
+    nabycia_.dodaj();
+    oczekiwanie_.zapisz(oczekiwanie_ns);
+    if (rywalizacja) {
+      rywalizacje_.dodaj();
+    }
+    if (Miejsce* wpis = znajdz_miejsce(miejsce)) {
+      wpis->nabycia.fetch_add(1, std::memory_order_relaxed);
+      wpis->oczekiwanie_ns.fetch_add(oczekiwanie_ns, std::memory_order_relaxed);
+    }
+  }
+
+  void zapisz_trzymanie(uint64_t trzymanie_ns) { trzymanie_.zapisz(trzymanie_ns); }
+
+  const char* nazwa() const { return nazwa_; }
+  uint64_t nabycia() const { return nabycia_.wartosc(); }
+  uint64_t rywalizacje() const { return rywalizacje_.wartosc(); }
+  const metryki::Histogram& oczekiwanie() const { return oczekiwanie_; }
+  const metryki::Histogram& trzymanie() const { return trzymanie_; }
+  const std::array<Miejsce, kLiczbaMiejsc>& miejsca() const { return miejsca_; }
+
+ private:
+  Miejsce* znajdz_miejsce(const char* miejsce) {
+    size_t start = std::hash<const void*>{}(miejsce) % kLiczbaMiejsc;
+    for (size_t i = 0; i < kLiczbaMiejsc; ++i) {
+      Miejsce& wpis = miejsca_[(start + i) % kLiczbaMiejsc];
+      const char* obecne = wpis.nazwa.load(std::memory_order_acquire);
+      if (obecne == miejsce) {
+        return &wpis;
+      }
+      if (obecne == nullptr &&
+          (wpis.nazwa.compare_exchange_strong(obecne, miejsce, std::memory_order_acq_rel) ||
+           obecne == miejsce)) {
+        return &wpis;
+      }
+    }
+    return nullptr;
+  }
+
+  const char* nazwa_;
+  metryki::Histogram* metryka_oczekiwania_;
+  metryki::Licznik nabycia_;
+  metryki::Licznik rywalizacje_;
+  metryki::Histogram oczekiwanie_;
+  metryki::Histogram trzymanie_;
+  std::array<Miejsce, kLiczbaMiejsc> miejsca_;
+};
+
+template <typename Podstawowy>
+class Mutex {
+ public:
+  explicit Mutex(Profil& profil) : profil_(&profil) {}
+
+  Mutex(const Mutex&) = delete;
+  Mutex& operator=(const Mutex&) = delete;
+
+  template <bool Wspoldzielona>
+  Chwila nabadz(const char* miejsce) {
+    bool profiluj = profilowanie_wlaczone();
+    if (sprobuj<Wspoldzielona>()) {
+      if (!profiluj) {
+        return {};
+      }
+      profil_->zapisz_nabycie(miejsce, 0, false);
+      return std::chrono::steady_clock::now();
+    }
+    Chwila start = std::chrono::steady_clock::now();
+    if constexpr (Wspoldzielona) {
+      mutex_.lock_shared();
+    } else {
+      mutex_.lock();
+    }
+    Chwila teraz = std::chrono::steady_clock::now();
+    uint64_t oczekiwanie_ns = nanosekundy(start, teraz);
+    profil_->zapisz_rywalizacje(oczekiwanie_ns);
+    if (!profiluj) {
+      return {};
+    }
+    profil_->zapisz_nabycie(miejsce, oczekiwanie_ns, true);
+    return teraz;
+  }
+
+  template <bool Wspoldzielona>
+  void zwolnij(Chwila nabyto) {
+    if (nabyto != Chwila{}) {
+      profil_->zapisz_trzymanie(nanosekundy(nabyto, std::chrono::steady_clock::now()));
+    }
+    if constexpr (Wspoldzielona) {
+      mutex_.unlock_shared();
+    } else {
+      mutex_.unlock();
+    }
+  }
+
+ private:
+  template <bool Wspoldzielona>
+  bool sprobuj() {
+    if constexpr (Wspoldzielona) {
+      return mutex_.try_lock_shared();
+    } else {
+      return mutex_.try_lock();
+    }
+  }
+
+  Podstawowy mutex_;
+  Profil* profil_;
+};
+
+template <typename Podstawowy, bool Wspoldzielona>
+class Straznik {
+ public:
+  explicit Straznik(Mutex<Podstawowy>& mutex, const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA)
+      : mutex_(&mutex), miejsce_(miejsce) {
+    lock();
+  }
+
+  Straznik(Mutex<Podstawowy>& mutex,
+           std::defer_lock_t,
+           const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA)
+      : mutex_(&mutex), miejsce_(miejsce) {}
+
+  ~Straznik() {
+    if (zablokowany_) {
+      unlock();
+    }
+  }
+
+  Straznik(const Straznik&) = delete;
+  Straznik& operator=(const Straznik&) = delete;
+
+  void lock() {
+    nabyto_ = mutex_->template nabadz<Wspoldzielona>(miejsce_);
+    zablokowany_ = true;
+  }
+
+  void unlock() {
+    zablokowany_ = false;
+    mutex_->template zwolnij<Wspoldzielona>(nabyto_);
+  }
+
+ private:
+  Mutex<Podstawowy>* mutex_;
+  const char* miejsce_;
+  Chwila nabyto_{};
+  bool zablokowany_ = false;
+};
+
+template <typename Podstawowy>
+using Wylaczna = Straznik<Podstawowy, false>;
+
+template <typename Podstawowy>
+using Wspoldzielona = Straznik<Podstawowy, true>;
+
+inline std::string raport(size_t limit_blokad, size_t limit_miejsc) {
+  struct Wiersz {
+    const Profil* profil;
+    metryki::Histogram::Stan oczekiwanie;
+    metryki::Histogram::Stan trzymanie;
+  };
+  std::vector<Wiersz> wiersze;
+  {
+    std::lock_guard<std::mutex> blokada(mutex_profili());
+    for (const Profil* profil : profile()) {
+      wiersze.push_back({profil, profil->oczekiwanie().stan(), profil->trzymanie().stan()});
+    }
+  }
+  std::sort(wiersze.begin(), wiersze.end(), [](const Wiersz& a, const Wiersz& b) {
+    return a.oczekiwanie.suma != b.oczekiwanie.suma ? a.oczekiwanie.suma > b.oczekiwanie.suma
+                                                    : a.oczekiwanie.liczba > b.oczekiwanie.liczba;
+  });
+  std::string wynik;
+  char linia[256];
+  size_t pozycja = 0;
+  for (const Wiersz& wiersz : wiersze) {
+    if (pozycja == limit_blokad || wiersz.oczekiwanie.liczba == 0) {
+      break;
+    }
+    uint64_t rywalizacje = wiersz.profil->rywalizacje();
+    std::snprintf(linia, sizeof(linia),
+                  "%zu. %s: nabycia=%llu, rywalizacje=%llu (%.1f%%), oczekiwanie=%.3f ms "
+                  "(p99<=%llu us), trzymanie p50<=%llu us p99<=%llu us\n",
+                  ++pozycja, wiersz.profil->nazwa(),
+                  static_cast<unsigned long long>(wiersz.oczekiwanie.liczba),
+                  static_cast<unsigned long long>(rywalizacje),
+                  100.0 * static_cast<double>(rywalizacje) /
+                      static_cast<double>(wiersz.oczekiwanie.liczba),
+                  static_cast<double>(wiersz.oczekiwanie.suma) / 1e6,
+                  static_cast<unsigned long long>(metryki::kwantyl(wiersz.oczekiwanie, 0.99) / 1000),
+                  static_cast<unsigned long long>(metryki::kwantyl(wiersz.trzymanie, 0.5) / 1000),
+                  static_cast<unsigned long long>(metryki::kwantyl(wiersz.trzymanie, 0.99) / 1000));
+    wynik += linia;
+    std::vector<std::pair<uint64_t, const Profil::Miejsce*>> miejsca;
+    for (const Profil::Miejsce& miejsce : wiersz.profil->miejsca()) {
+      if (miejsce.nazwa.load(std::memory_order_acquire) != nullptr) {
+        miejsca.emplace_back(miejsce.oczekiwanie_ns.load(std::memory_order_relaxed), &miejsce);
+      }
+    }
+    std::sort(miejsca.begin(), miejsca.end(), [](const auto& a, const auto& b) {
+      return a.first != b.first ? a.first > b.first
+                                : a.second->nabycia.load(std::memory_order_relaxed) >
+                                      b.second->nabycia.load(std::memory_order_relaxed);
+    });
+    if (miejsca.size() > limit_miejsc) {
+      miejsca.resize(limit_miejsc);
+    }
+    for (const auto& [oczekiwanie_ns, miejsce] : miejsca) {
+      std::snprintf(linia, sizeof(linia), "   %s: nabycia=%llu, oczekiwanie=%.3f ms\n",
+                    miejsce->nazwa.load(std::memory_order_relaxed),
+                    static_cast<unsigned long long>(miejsce->nabycia.load(std::memory_order_relaxed)),
+                    static_cast<double>(oczekiwanie_ns) / 1e6);
+      wynik += linia;
+    }
+  }
+  return wynik;
+}
+
+}  // namespace blokady
+
+#endif
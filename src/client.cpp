@@ -7,6 +7,7 @@
 #include <QtCore/QDateTime>
 #include <QtCore/QHash>
 #include <QtCore/QRandomGenerator>
+#include <QtCore/QSet>
 #include <QtCore/QTimer>
 #include <QtCore/QVector>
 #include <QtNetwork/QHostAddress>
@@ -30,9 +31,12 @@
 #include <QtWidgets/QTextEdit>
 #include <QtWidgets/QVBoxLayout>
 
+#include "protokol.hpp"
+
 namespace {
 constexpr int kMaksLiniiPokoju = 200;
 constexpr int kMaksPowiadomien = 20;
+constexpr size_t kMaksRozmiarRamki = 64 * 1024;
 }
 
 class PrywatnyCzatDialog : public QDialog {
@@ -288,19 +292,61 @@ class OknoCzatu : public QMainWindow {
     dialog->activateWindow();
   }
 
+  void ustawPokoj(const QString& nazwa, bool zablokowany) {
+    QListWidgetItem* element = elementy_pokoi_.value(nazwa, nullptr);
+    if (!element) {
+      element = new QListWidgetItem(lista_pokoi_);
+      element->setData(Qt::UserRole, nazwa);
+      elementy_pokoi_.insert(nazwa, element);
+    }
+    element->setText(
+        QStringLiteral("%1%2").arg(nazwa, zablokowany ? QStringLiteral(" (locked)") : QString()));
+    element->setData(Qt::UserRole + 1, zablokowany);
+  }
+
+  void usunPokoj(const QString& nazwa) {
+    delete elementy_pokoi_.take(nazwa);
+  }
+
   void aktualizujPokoje(const QString& ladunek) {
-    lista_pokoi_->clear();
     const QStringList tokeny = ladunek.split('|', Qt::SkipEmptyParts);
+    QSet<QString> obecne;
     for (int i = 0; i + 1 < tokeny.size(); i += 2) {
       const QString nazwa = tokeny.at(i);
-      const QString status = tokeny.at(i + 1);
-      const bool zablokowany = status == QStringLiteral("locked");
-      auto* element = new QListWidgetItem(
-          QStringLiteral("%1%2").arg(nazwa, zablokowany ? QStringLiteral(" (locked)") : QString()),
-          lista_pokoi_);
-      element->setData(Qt::UserRole, nazwa);
-      element->setData(Qt::UserRole + 1, zablokowany);
+      obecne.insert(nazwa);
+      ustawPokoj(nazwa, tokeny.at(i + 1) == QStringLiteral("locked"));
+    }
+    const QStringList znane = elementy_pokoi_.keys();
+    for (const QString& nazwa : znane) {
+      if (!obecne.contains(nazwa)) {
+        usunPokoj(nazwa);
+      }
+    }
+  }
+
+  void zastosujZmianePokoju(const QString& linia) {
+    const QStringList tokeny = linia.split('|');
+    if (tokeny.size() < 3) {
+      return;
     }
+    bool poprawna = false;
+    const qint64 wersja = tokeny.at(1).toLongLong(&poprawna);
+    if (!poprawna || wersja_pokoi_ < 0 || wersja <= wersja_pokoi_) {
+      return;
+    }
+    if (wersja != wersja_pokoi_ + 1) {
+      wyslijLinie(QStringLiteral("/rooms %1").arg(wersja_pokoi_));
+      return;
+    }
+    const QString& rodzaj = tokeny.at(0);
+    const QString& nazwa = tokeny.at(2);
+    const bool zablokowany = tokeny.size() > 3 && tokeny.at(3) == QStringLiteral("locked");
+    if (rodzaj == QStringLiteral("ROOM_REMOVED")) {
+      usunPokoj(nazwa);
+    } else {
+      ustawPokoj(nazwa, zablokowany);
+    }
+    wersja_pokoi_ = wersja;
   }
 
   void obsluzPrywatnaWiadomosc(const QString& linia) {
@@ -310,9 +356,11 @@ class OknoCzatu : public QMainWindow {
       dodajLiniePokoju(linia);
       return;
     }
-    const QString nadawca = ladunek.left(indeks_dwukropka).trimmed();
-    const QString wiadomosc = ladunek.mid(indeks_dwukropka + 1).trimmed();
+    obsluzPrywatnaWiadomosc(ladunek.left(indeks_dwukropka).trimmed(),
+                            ladunek.mid(indeks_dwukropka + 1).trimmed());
+  }
 
+  void obsluzPrywatnaWiadomosc(const QString& nadawca, const QString& wiadomosc) {
     auto* dialog = prywatne_czaty_.value(nadawca, nullptr);
     if (dialog) {
       dialog->dodajWiadomosc(QStringLiteral("%1: %2").arg(nadawca, wiadomosc));
@@ -327,8 +375,83 @@ class OknoCzatu : public QMainWindow {
                            QStringLiteral("Brak połączenia z serwerem."));
       return;
     }
-    const QByteArray dane = (linia + "\n").toUtf8();
-    gniazdo_->write(dane);
+    const QByteArray dane = linia.toUtf8();
+    if (!binarny_) {
+      gniazdo_->write(dane + "\n");
+      return;
+    }
+    std::string ramka;
+    protokol::dopisz_ramke(&ramka, protokol::TypRamki::Tekst, {},
+                           std::string_view(dane.constData(), static_cast<size_t>(dane.size())));
+    gniazdo_->write(ramka.data(), static_cast<qint64>(ramka.size()));
+  }
+
+  void obsluzLinie(const QString& linia) {
+    if (linia.isEmpty()) {
+      return;
+    }
+    if (linia.startsWith(QStringLiteral("ROOMS|"))) {
+      aktualizujPokoje(linia.mid(6));
+      return;
+    }
+    if (linia.startsWith(QStringLiteral("ROOM_VERSION|"))) {
+      wersja_pokoi_ = linia.mid(13).toLongLong();
+      return;
+    }
+    if (linia.startsWith(QStringLiteral("ROOM_ADDED|")) ||
+        linia.startsWith(QStringLiteral("ROOM_REMOVED|")) ||
+        linia.startsWith(QStringLiteral("ROOM_LOCKED|"))) {
+      zastosujZmianePokoju(linia);
+      return;
+    }
+    if (linia.startsWith(QStringLiteral("ROOM|"))) {
+      const QString pokoj = linia.mid(5).trimmed();
+      etykieta_aktualnego_pokoju_->setText(QStringLiteral("Aktualny pokój: %1").arg(pokoj));
+      return;
+    }
+    if (linia.startsWith(QStringLiteral("[private]"))) {
+      obsluzPrywatnaWiadomosc(linia);
+      return;
+    }
+    dodajLiniePokoju(linia);
+  }
+
+  static QString tekstRamki(std::string_view dane) {
+    return QString::fromUtf8(dane.data(), static_cast<int>(dane.size()));
+  }
+
+  void obsluzRamke(protokol::TypRamki typ, std::string_view ladunek) {
+    uint64_t pierwszy = 0;
+    uint64_t drugi = 0;
+    switch (typ) {
+      case protokol::TypRamki::Tekst:
+        obsluzLinie(tekstRamki(ladunek).trimmed());
+        break;
+      case protokol::TypRamki::DefinicjaUzytkownika:
+        if (protokol::odczytaj_varint(&ladunek, &pierwszy)) {
+          nazwy_uzytkownikow_.insert(pierwszy, tekstRamki(ladunek));
+        }
+        break;
+      case protokol::TypRamki::DefinicjaPokoju:
+        if (protokol::odczytaj_varint(&ladunek, &pierwszy)) {
+          nazwy_pokoi_.insert(pierwszy, tekstRamki(ladunek));
+        }
+        break;
+      case protokol::TypRamki::WiadomoscPokoju:
+        if (protokol::odczytaj_varint(&ladunek, &pierwszy) &&
+            protokol::odczytaj_varint(&ladunek, &drugi)) {
+          dodajLiniePokoju(QStringLiteral("[%1] %2: %3")
+                               .arg(nazwy_pokoi_.value(pierwszy), nazwy_uzytkownikow_.value(drugi),
+                                    tekstRamki(ladunek)));
+        }
+        break;
+      case protokol::TypRamki::WiadomoscPrywatna:
+        if (protokol::odczytaj_varint(&ladunek, &pierwszy) &&
+            protokol::odczytaj_varint(&ladunek, &drugi)) {
+          obsluzPrywatnaWiadomosc(nazwy_uzytkownikow_.value(pierwszy), tekstRamki(ladunek));
+        }
+        break;
+    }
   }
 
  private slots:
@@ -336,40 +459,49 @@ class OknoCzatu : public QMainWindow {
     dodajLiniePokoju(
         QStringLiteral("Połączono z %1:%2.").arg(adres_hosta_).arg(port_));
     wyslijLinie(QStringLiteral("/rooms"));
+    wyslijLinie(QStringLiteral("/proto %1")
+                    .arg(QString::fromLatin1(protokol::kNazwaBinarnego.data(),
+                                             static_cast<int>(protokol::kNazwaBinarnego.size()))));
   }
 
   void poRozlaczeniu() {
+    wersja_pokoi_ = -1;
+    binarny_ = false;
+    dekoder_ = protokol::DekoderRamek();
+    bufor_.clear();
+    nazwy_uzytkownikow_.clear();
+    nazwy_pokoi_.clear();
     dodajLiniePokoju(QStringLiteral("Rozłączono z serwerem."));
     zatrzymajPokojTestowy();
   }
 
   void poOdczycie() {
     bufor_.append(gniazdo_->readAll());
-    while (true) {
+    while (!binarny_) {
       int indeks_nowej_linii = bufor_.indexOf('\n');
       if (indeks_nowej_linii < 0) {
-        break;
+        return;
       }
       const QByteArray dane_linii = bufor_.left(indeks_nowej_linii);
       bufor_.remove(0, indeks_nowej_linii + 1);
       const QString linia = QString::fromUtf8(dane_linii).trimmed();
-      if (linia.isEmpty()) {
-        continue;
-      }
-      if (linia.startsWith(QStringLiteral("ROOMS|"))) {
-        aktualizujPokoje(linia.mid(6));
-        continue;
-      }
-      if (linia.startsWith(QStringLiteral("ROOM|"))) {
-        const QString pokoj = linia.mid(5).trimmed();
-        etykieta_aktualnego_pokoju_->setText(QStringLiteral("Aktualny pokój: %1").arg(pokoj));
-        continue;
-      }
-      if (linia.startsWith(QStringLiteral("[private]"))) {
-        obsluzPrywatnaWiadomosc(linia);
-        continue;
+      if (linia == QStringLiteral("PROTO|%1")
+                       .arg(QString::fromLatin1(
+                           protokol::kNazwaBinarnego.data(),
+                           static_cast<int>(protokol::kNazwaBinarnego.size())))) {
+        binarny_ = true;
+        break;
       }
-      dodajLiniePokoju(linia);
+      obsluzLinie(linia);
+    }
+    const QByteArray dane = bufor_;
+    bufor_.clear();
+    const bool poprawne = dekoder_.przyjmij(
+        dane.constData(), static_cast<size_t>(dane.size()), kMaksRozmiarRamki,
+        [this](protokol::TypRamki typ, std::string_view ladunek) { obsluzRamke(typ, ladunek); });
+    if (!poprawne) {
+      dodajLiniePokoju(QStringLiteral("Błędna ramka od serwera, rozłączanie."));
+      gniazdo_->abort();
     }
   }
 
@@ -582,6 +714,10 @@ class OknoCzatu : public QMainWindow {
   int port_ = 0;
   QTcpSocket* gniazdo_ = nullptr;
   QByteArray bufor_;
+  bool binarny_ = false;
+  protokol::DekoderRamek dekoder_;
+  QHash<quint64, QString> nazwy_uzytkownikow_;
+  QHash<quint64, QString> nazwy_pokoi_;
 
   QLineEdit* pole_nazwy_ = nullptr;
   QLineEdit* pole_nazwy_pokoju_ = nullptr;
@@ -589,6 +725,8 @@ class OknoCzatu : public QMainWindow {
   QTimer* timer_ladowania_ = nullptr;
 
   QListWidget* lista_pokoi_ = nullptr;
+  QHash<QString, QListWidgetItem*> elementy_pokoi_;
+  qint64 wersja_pokoi_ = -1;
   QListWidget* lista_powiadomien_ = nullptr;
   QTextEdit* widok_czatu_pokoju_ = nullptr;
   QLabel* etykieta_aktualnego_pokoju_ = nullptr;
@@ -0,0 +1,149 @@
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "kompresja.hpp"
+#include "magazyn.hpp"
+
+namespace {
+struct Filtry {
+  std::string katalog;
+  std::string pokoj;
+  std::string uzytkownik;
+  std::string archiwum;
+  int64_t od_us = std::numeric_limits<int64_t>::min();
+  int64_t do_us = std::numeric_limits<int64_t>::max();
+};
+
+bool wartosc_opcji(const std::string& argument, const std::string& nazwa, std::string* wartosc) {
+  if (argument.rfind(nazwa + "=", 0) != 0) {
+    return false;
+  }
+  *wartosc = argument.substr(nazwa.size() + 1);
+  return true;
+}
+
+bool odczytaj_sekundy(const std::string& tekst, int64_t* mikrosekundy) {
+  if (tekst.empty()) {
+    return false;
+  }
+  char* koniec = nullptr;
+  long long sekundy = std::strtoll(tekst.c_str(), &koniec, 10);
+  if (*koniec != '\0') {
+    return false;
+  }
+  *mikrosekundy = static_cast<int64_t>(sekundy) * 1000000;
+  return true;
+}
+
+bool parsuj_argumenty(int liczba_argumentow, char* argumenty[], Filtry* filtry) {
+  for (int i = 1; i < liczba_argumentow; ++i) {
+    std::string argument = argumenty[i];
+    std::string wartosc;
+    if (argument.rfind("--", 0) != 0) {
+      if (!filtry->katalog.empty()) {
+        std::cerr << "Nadmiarowy argument: " << argument << "\n";
+        return false;
+      }
+      filtry->katalog = argument;
+    } else if (wartosc_opcji(argument, "--unpack", &wartosc)) {
+      filtry->archiwum = wartosc;
+    } else if (wartosc_opcji(argument, "--room", &wartosc)) {
+      filtry->pokoj = wartosc;
+    } else if (wartosc_opcji(argument, "--user", &wartosc)) {
+      filtry->uzytkownik = wartosc;
+    } else if (wartosc_opcji(argument, "--since", &wartosc)) {
+      if (!odczytaj_sekundy(wartosc, &filtry->od_us)) {
+        std::cerr << "Nieprawidłowy początek zakresu: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--until", &wartosc)) {
+      if (!odczytaj_sekundy(wartosc, &filtry->do_us)) {
+        std::cerr << "Nieprawidłowy koniec zakresu: " << wartosc << "\n";
+        return false;
+      }
+    } else {
+      std::cerr << "Nieznana opcja: " << argument << "\n";
+      return false;
+    }
+  }
+  return filtry->katalog.empty() != filtry->archiwum.empty();
+}
+
+bool znajdz_identyfikator(const std::vector<std::string>& nazwy,
+                          const std::string& nazwa,
+                          uint32_t* identyfikator) {
+  for (size_t i = 1; i < nazwy.size(); ++i) {
+    if (nazwy[i] == nazwa) {
+      *identyfikator = static_cast<uint32_t>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void dopisz_znacznik(int64_t czas_us, std::string* cel) {
+  std::time_t sekundy = static_cast<std::time_t>(czas_us / 1000000);
+  std::tm rozlozony{};
+#ifdef _WIN32
+  localtime_s(&rozlozony, &sekundy);
+#else
+  localtime_r(&sekundy, &rozlozony);
+#endif
+  char tekst[sizeof("YYYY-mm-dd HH:MM:SS")];
+  std::strftime(tekst, sizeof(tekst), "%Y-%m-%d %H:%M:%S", &rozlozony);
+  *cel += '[';
+  *cel += tekst;
+  *cel += "] ";
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  Filtry filtry;
+  if (!parsuj_argumenty(liczba_argumentow, argumenty, &filtry)) {
+    std::cerr << "Użycie: " << argumenty[0]
+              << " katalog_magazynu [--room=POKÓJ] [--user=UŻYTKOWNIK] [--since=SEKUNDY_UNIX]"
+                 " [--until=SEKUNDY_UNIX]\n"
+              << "       " << argumenty[0] << " --unpack=PLIK.lzb\n";
+    return 1;
+  }
+  if (!filtry.archiwum.empty()) {
+    if (!kompresja::dekompresuj_plik(filtry.archiwum, stdout)) {
+      std::cerr << "Nie można rozpakować archiwum logu: " << filtry.archiwum << "\n";
+      return 1;
+    }
+    return 0;
+  }
+  magazyn::Magazyn magazyn;
+  if (!magazyn.otworz(filtry.katalog, magazyn::kMinimalnyRozmiarSegmentu, true)) {
+    std::cerr << "Nie można otworzyć magazynu wiadomości: " << filtry.katalog << "\n";
+    return 1;
+  }
+  uint32_t id_pokoju = 0;
+  if (!filtry.pokoj.empty() &&
+      !znajdz_identyfikator(magazyn.nazwy_pokoi(), filtry.pokoj, &id_pokoju)) {
+    return 0;
+  }
+  uint32_t id_uzytkownika = 0;
+  if (!filtry.uzytkownik.empty() &&
+      !znajdz_identyfikator(magazyn.nazwy_uzytkownikow(), filtry.uzytkownik, &id_uzytkownika)) {
+    return 0;
+  }
+
+  std::string linia;
+  magazyn.przegladaj(filtry.od_us, filtry.do_us, id_pokoju, [&](const magazyn::Rekord& rekord) {
+    if (id_uzytkownika != 0 && rekord.id_nadawcy != id_uzytkownika &&
+        rekord.id_odbiorcy != id_uzytkownika) {
+      return;
+    }
+    linia.clear();
+    dopisz_znacznik(rekord.czas_us, &linia);
+    linia.append(rekord.tresc);
+    linia += '\n';
+    std::fwrite(linia.data(), 1, linia.size(), stdout);
+  });
+  return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef CHATAPP_KOMENDY_HPP
+#define CHATAPP_KOMENDY_HPP
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace komendy {
+
+constexpr std::string_view kBialeZnaki = " \t\r\n";
+
+inline std::string_view przytnij(std::string_view tekst) {
+  size_t start = tekst.find_first_not_of(kBialeZnaki);
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t koniec = tekst.find_last_not_of(kBialeZnaki);
+  return tekst.substr(start, koniec - start + 1);
+}
+
+inline std::string_view nastepny_token(std::string_view* reszta) {
+  size_t start = reszta->find_first_not_of(kBialeZnaki);
+  if (start == std::string_view::npos) {
+    *reszta = {};
+    return {};
+  }
+  size_t koniec = reszta->find_first_of(kBialeZnaki, start);
+  if (koniec == std::string_view::npos) {
+    koniec = reszta->size();
+  }
+  std::string_view token = reszta->substr(start, koniec - start);
+  reszta->remove_prefix(koniec);
+  return token;
+}
+
+struct Komenda {
+  std::string_view nazwa;
+  std::string_view argumenty;
+};
+
+inline bool rozloz_komende(std::string_view linia, Komenda* komenda) {
+  if (linia.size() < 2 || linia.front() != '/') {
+    return false;
+  }
+  linia.remove_prefix(1);
+  size_t koniec_nazwy = linia.find_first_of(kBialeZnaki);
+  if (koniec_nazwy == 0) {
+    return false;
+  }
+  if (koniec_nazwy == std::string_view::npos) {
+    komenda->nazwa = linia;
+    komenda->argumenty = {};
+  } else {
+    komenda->nazwa = linia.substr(0, koniec_nazwy);
+    komenda->argumenty = przytnij(linia.substr(koniec_nazwy));
+  }
+  return true;
+}
+
+template <typename Kontekst>
+class Dyspozytor {
+ public:
+  using Obsluga = void (*)(Kontekst&, std::string_view argumenty);
+
+  struct Wpis {
+    std::string_view nazwa;
+    Obsluga obsluga;
+  };
+
+  template <size_t N>
+  explicit Dyspozytor(const std::array<Wpis, N>& wbudowane) {
+    for (const Wpis& wpis : wbudowane) {
+      zarejestruj(wpis.nazwa, wpis.obsluga);
+    }
+  }
+
+  bool zarejestruj(std::string_view nazwa, Obsluga obsluga) {
+    if (nazwa.empty() || obsluga == nullptr || znajdz(nazwa) != nullptr) {
+      return false;
+    }
+    kubelki_[indeks_kubelka(nazwa)].push_back({std::string(nazwa), obsluga});
+    return true;
+  }
+
+  Obsluga znajdz(std::string_view nazwa) const {
+    if (nazwa.empty()) {
+      return nullptr;
+    }
+    for (const Zarejestrowana& kandydat : kubelki_[indeks_kubelka(nazwa)]) {
+      if (kandydat.nazwa == nazwa) {
+        return kandydat.obsluga;
+      }
+    }
+    return nullptr;
+  }
+
+  bool wykonaj(Kontekst& kontekst, std::string_view linia) const {
+    Komenda komenda;
+    if (!rozloz_komende(linia, &komenda)) {
+      return false;
+    }
+    Obsluga obsluga = znajdz(komenda.nazwa);
+    if (obsluga == nullptr) {
+      return false;
+    }
+    obsluga(kontekst, komenda.argumenty);
+    return true;
+  }
+
+ private:
+  struct Zarejestrowana {
+    std::string nazwa;
+    Obsluga obsluga;
+  };
+
+  static constexpr size_t kLiczbaKubelkow = 64;
+
+  static size_t indeks_kubelka(std::string_view nazwa) {
+    return (static_cast<unsigned char>(nazwa.front()) ^ (nazwa.size() << 3)) % kLiczbaKubelkow;
+  }
+
+  std::array<std::vector<Zarejestrowana>, kLiczbaKubelkow> kubelki_;
+};
+
+}  // namespace komendy
+
+#endif
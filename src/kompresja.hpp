@@ -0,0 +1,229 @@
+#ifndef CHATAPP_KOMPRESJA_HPP
+#define CHATAPP_KOMPRESJA_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace kompresja {
+
+constexpr char kSygnatura[4] = {'L', 'Z', 'B', '1'};
+constexpr size_t kRozmiarBloku = 64 * 1024;
+constexpr size_t kMinimalneDopasowanie = 4;
+constexpr int kBityHasza = 12;
+constexpr uint32_t kBlokNieskompresowany = 0x80000000u;
+constexpr uint32_t kBrakPozycji = 0xffffffffu;
+
+inline void dopisz_dlugosc(std::string* cel, size_t dlugosc) {
+  while (dlugosc >= 255) {
+    cel->push_back(static_cast<char>(255));
+    dlugosc -= 255;
+  }
+  cel->push_back(static_cast<char>(dlugosc));
+}
+
+inline void dopisz_sekwencje(std::string* cel,
+                             const char* literaly,
+                             size_t liczba_literalow,
+                             size_t przesuniecie,
+                             size_t dlugosc_dopasowania) {
+  size_t dopasowanie = dlugosc_dopasowania == 0 ? 0 : dlugosc_dopasowania - kMinimalneDopasowanie;
+  uint8_t token = static_cast<uint8_t>((std::min<size_t>(liczba_literalow, 15) << 4) |
+                                       std::min<size_t>(dopasowanie, 15));
+  cel->push_back(static_cast<char>(token));
+  if (liczba_literalow >= 15) {
+    dopisz_dlugosc(cel, liczba_literalow - 15);
+  }
+  cel->append(literaly, liczba_literalow);
+  if (dlugosc_dopasowania == 0) {
+    return;
+  }
+  cel->push_back(static_cast<char>(przesuniecie & 0xff));
+  cel->push_back(static_cast<char>(przesuniecie >> 8));
+  if (dopasowanie >= 15) {
+    dopisz_dlugosc(cel, dopasowanie - 15);
+  }
+}
+
+inline void kompresuj_blok(const char* dane,
+                           size_t rozmiar,
+                           std::vector<uint32_t>* tablica,
+                           std::string* cel) {
+  tablica->assign(size_t{1} << kBityHasza, kBrakPozycji);
+  size_t kotwica = 0;
+  size_t pozycja = 0;
+  while (pozycja + kMinimalneDopasowanie <= rozmiar) {
+    uint32_t cztery = 0;
+    std::memcpy(&cztery, dane + pozycja, sizeof(cztery));
+    uint32_t hasz = (cztery * 2654435761u) >> (32 - kBityHasza);
+    uint32_t kandydat = (*tablica)[hasz];
+    (*tablica)[hasz] = static_cast<uint32_t>(pozycja);
+    if (kandydat == kBrakPozycji || pozycja - kandydat > 0xffff ||
+        std::memcmp(dane + kandydat, dane + pozycja, kMinimalneDopasowanie) != 0) {
+      ++pozycja;
+      continue;
+    }
+    size_t dlugosc = kMinimalneDopasowanie;
+    while (pozycja + dlugosc < rozmiar && dane[kandydat + dlugosc] == dane[pozycja + dlugosc]) {
+      ++dlugosc;
+    }
+    dopisz_sekwencje(cel, dane + kotwica, pozycja - kotwica, pozycja - kandydat, dlugosc);
+    pozycja += dlugosc;
+    kotwica = pozycja;
+  }
+  dopisz_sekwencje(cel, dane + kotwica, rozmiar - kotwica, 0, 0);
+}
+
+inline bool odczytaj_dlugosc(const uint8_t*& wejscie, const uint8_t* koniec, size_t* dlugosc) {
+  uint8_t bajt = 255;
+  while (bajt == 255) {
+    if (wejscie == koniec) {
+      return false;
+    }
+    bajt = *wejscie++;
+    *dlugosc += bajt;
+  }
+  return true;
+}
+
+inline bool dekompresuj_blok(const char* dane,
+                             size_t rozmiar,
+                             size_t rozmiar_wyniku,
+                             std::string* cel) {
+  const uint8_t* wejscie = reinterpret_cast<const uint8_t*>(dane);
+  const uint8_t* koniec = wejscie + rozmiar;
+  size_t poczatek = cel->size();
+  while (wejscie < koniec) {
+    uint8_t token = *wejscie++;
+    size_t literaly = token >> 4;
+    if (literaly == 15 && !odczytaj_dlugosc(wejscie, koniec, &literaly)) {
+      return false;
+    }
+    if (literaly > static_cast<size_t>(koniec - wejscie) ||
+        cel->size() - poczatek + literaly > rozmiar_wyniku) {
+      return false;
+    }
+    cel->append(reinterpret_cast<const char*>(wejscie), literaly);
+    wejscie += literaly;
+    if (wejscie == koniec) {
+      break;
+    }
+    if (koniec - wejscie < 2) {
+      return false;
+    }
+    size_t przesuniecie = wejscie[0] | (static_cast<size_t>(wejscie[1]) << 8);
+    wejscie += 2;
+    size_t dlugosc = token & 0x0f;
+    if (dlugosc == 15 && !odczytaj_dlugosc(wejscie, koniec, &dlugosc)) {
+      return false;
+    }
+    dlugosc += kMinimalneDopasowanie;
+    size_t wytworzone = cel->size() - poczatek;
+    if (przesuniecie == 0 || przesuniecie > wytworzone ||
+        wytworzone + dlugosc > rozmiar_wyniku) {
+      return false;
+    }
+    size_t zrodlo = cel->size() - przesuniecie;
+    for (size_t i = 0; i < dlugosc; ++i) {
+      cel->push_back((*cel)[zrodlo + i]);
+    }
+  }
+  return cel->size() - poczatek == rozmiar_wyniku;
+}
+
+inline void dopisz_u32(std::string* cel, uint32_t wartosc) {
+  char bajty[4];
+  std::memcpy(bajty, &wartosc, sizeof(bajty));
+  cel->append(bajty, sizeof(bajty));
+}
+
+inline bool kompresuj_plik(const std::string& zrodlo, const std::string& cel) {
+  std::FILE* wejscie = std::fopen(zrodlo.c_str(), "rb");
+  if (!wejscie) {
+    return false;
+  }
+  std::FILE* wyjscie = std::fopen(cel.c_str(), "wb");
+  if (!wyjscie) {
+    std::fclose(wejscie);
+    return false;
+  }
+  std::vector<char> blok(kRozmiarBloku);
+  std::vector<uint32_t> tablica;
+  std::string skompresowany;
+  std::string ramka(kSygnatura, sizeof(kSygnatura));
+  bool poprawny = true;
+  size_t przeczytano = 0;
+  while (poprawny && (przeczytano = std::fread(blok.data(), 1, blok.size(), wejscie)) > 0) {
+    skompresowany.clear();
+    kompresuj_blok(blok.data(), przeczytano, &tablica, &skompresowany);
+    dopisz_u32(&ramka, static_cast<uint32_t>(przeczytano));
+    if (skompresowany.size() < przeczytano) {
+      dopisz_u32(&ramka, static_cast<uint32_t>(skompresowany.size()));
+      ramka += skompresowany;
+    } else {
+      dopisz_u32(&ramka, static_cast<uint32_t>(przeczytano) | kBlokNieskompresowany);
+      ramka.append(blok.data(), przeczytano);
+    }
+    poprawny = std::fwrite(ramka.data(), 1, ramka.size(), wyjscie) == ramka.size();
+    ramka.clear();
+  }
+  if (!ramka.empty()) {
+    poprawny = std::fwrite(ramka.data(), 1, ramka.size(), wyjscie) == ramka.size();
+  }
+  poprawny = std::ferror(wejscie) == 0 && poprawny;
+  std::fclose(wejscie);
+  poprawny = std::fclose(wyjscie) == 0 && poprawny;
+  if (!poprawny) {
+    std::remove(cel.c_str());
+  }
+  return poprawny;
+}
+
+inline bool dekompresuj_plik(const std::string& zrodlo, std::FILE* wyjscie) {
+  std::FILE* wejscie = std::fopen(zrodlo.c_str(), "rb");
+  if (!wejscie) {
+    return false;
+  }
+  char sygnatura[sizeof(kSygnatura)];
+  bool poprawny = std::fread(sygnatura, 1, sizeof(sygnatura), wejscie) == sizeof(sygnatura) &&
+                  std::memcmp(sygnatura, kSygnatura, sizeof(sygnatura)) == 0;
+  std::vector<char> blok;
+  std::string wynik;
+  uint32_t naglowek[2];
+  while (poprawny) {
+    size_t przeczytano = std::fread(naglowek, 1, sizeof(naglowek), wejscie);
+    if (przeczytano != sizeof(naglowek)) {
+      poprawny = przeczytano == 0 && std::ferror(wejscie) == 0;
+      break;
+    }
+    uint32_t rozmiar_wyniku = naglowek[0];
+    uint32_t rozmiar = naglowek[1] & ~kBlokNieskompresowany;
+    bool surowy = (naglowek[1] & kBlokNieskompresowany) != 0;
+    if (rozmiar_wyniku > kRozmiarBloku || rozmiar > kRozmiarBloku) {
+      poprawny = false;
+      break;
+    }
+    blok.resize(rozmiar);
+    if (std::fread(blok.data(), 1, rozmiar, wejscie) != rozmiar) {
+      poprawny = false;
+      break;
+    }
+    wynik.clear();
+    if (surowy) {
+      poprawny = rozmiar == rozmiar_wyniku;
+      wynik.assign(blok.data(), rozmiar);
+    } else {
+      poprawny = dekompresuj_blok(blok.data(), rozmiar, rozmiar_wyniku, &wynik);
+    }
+    poprawny = poprawny && std::fwrite(wynik.data(), 1, wynik.size(), wyjscie) == wynik.size();
+  }
+  std::fclose(wejscie);
+  return poprawny;
+}
+
+}  // namespace kompresja
+
+#endif
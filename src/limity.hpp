@@ -0,0 +1,100 @@
+#ifndef CHATAPP_LIMITY_HPP
+#define CHATAPP_LIMITY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace limity {
+
+struct Limit {
+  int64_t odstep_ns = 0;
+  int64_t tolerancja_ns = 0;
+
+  bool wlaczony() const { return odstep_ns > 0; }
+};
+
+inline Limit utworz_limit(double na_sekunde, double seria) {
+  if (na_sekunde <= 0) {
+    return {};
+  }
+  int64_t odstep = std::max<int64_t>(1, static_cast<int64_t>(1e9 / na_sekunde));
+  return {odstep, static_cast<int64_t>(std::max(seria, 1.0) * static_cast<double>(odstep))};
+}
+
+inline bool odczytaj_liczbe(const std::string& tekst, double minimum, double* wynik) {
+  if (tekst.empty()) {
+    return false;
+  }
+  char* koniec = nullptr;
+  errno = 0;
+  double wartosc = std::strtod(tekst.c_str(), &koniec);
+  if (errno != 0 || *koniec != '\0' || !(wartosc >= minimum)) {
+    return false;
+  }
+  *wynik = wartosc;
+  return true;
+}
+
+inline bool parsuj_limit(const std::string& tekst, Limit* wynik) {
+  size_t dwukropek = tekst.find(':');
+  double na_sekunde = 0;
+  if (!odczytaj_liczbe(tekst.substr(0, dwukropek), 0, &na_sekunde)) {
+    return false;
+  }
+  double seria = na_sekunde;
+  if (dwukropek != std::string::npos &&
+      !odczytaj_liczbe(tekst.substr(dwukropek + 1), 1, &seria)) {
+    return false;
+  }
+  *wynik = utworz_limit(na_sekunde, seria);
+  return true;
+}
+
+inline int64_t teraz_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+class Kubelek {
+ public:
+  bool pobierz(const Limit& limit, int64_t teraz) {
+    int64_t nastepny = std::max(termin_, teraz) + limit.odstep_ns;
+    if (nastepny - teraz > limit.tolerancja_ns) {
+      return false;
+    }
+    termin_ = nastepny;
+    return true;
+  }
+
+ private:
+  int64_t termin_ = 0;
+};
+
+class WspolnyKubelek {
+ public:
+  bool pobierz(const Limit& limit, int64_t teraz) {
+    int64_t termin = termin_.load(std::memory_order_relaxed);
+    while (true) {
+      int64_t nastepny = std::max(termin, teraz) + limit.odstep_ns;
+      if (nastepny - teraz > limit.tolerancja_ns) {
+        return false;
+      }
+      if (termin_.compare_exchange_weak(termin, nastepny, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+
+ private:
+  std::atomic<int64_t> termin_{0};
+};
+
+}  // namespace limity
+
+#endif
@@ -0,0 +1,600 @@
+#ifndef CHATAPP_MAGAZYN_HPP
+#define CHATAPP_MAGAZYN_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace magazyn {
+
+enum class TypRekordu : uint8_t {
+  Zdarzenie = 1,
+  WiadomoscPokoju = 2,
+  WiadomoscPrywatna = 3,
+  DefinicjaUzytkownika = 4,
+  DefinicjaPokoju = 5,
+};
+
+struct Rekord {
+  TypRekordu typ = TypRekordu::Zdarzenie;
+  int64_t czas_us = 0;
+  uint32_t id_pokoju = 0;
+  uint32_t id_nadawcy = 0;
+  uint32_t id_odbiorcy = 0;
+  std::string_view tresc;
+};
+
+constexpr size_t kRozmiarNaglowka = 32;
+constexpr size_t kRozmiarBloku = 4096;
+constexpr size_t kMinimalnyRozmiarSegmentu = 1 << 20;
+
+inline size_t wyrownaj(size_t rozmiar) {
+  return (rozmiar + 7) & ~static_cast<size_t>(7);
+}
+
+inline void zakoduj_naglowek(const Rekord& rekord, char* cel) {
+  uint32_t dlugosc = static_cast<uint32_t>(rekord.tresc.size());
+  std::memset(cel, 0, kRozmiarNaglowka);
+  std::memcpy(cel, &rekord.czas_us, sizeof(rekord.czas_us));
+  std::memcpy(cel + 8, &dlugosc, sizeof(dlugosc));
+  std::memcpy(cel + 12, &rekord.id_pokoju, sizeof(rekord.id_pokoju));
+  std::memcpy(cel + 16, &rekord.id_nadawcy, sizeof(rekord.id_nadawcy));
+  std::memcpy(cel + 20, &rekord.id_odbiorcy, sizeof(rekord.id_odbiorcy));
+  cel[24] = static_cast<char>(rekord.typ);
+}
+
+inline bool odczytaj_rekord(const char* dane,
+                            size_t rozmiar,
+                            size_t przesuniecie,
+                            Rekord* rekord,
+                            size_t* nastepny) {
+  if (przesuniecie + kRozmiarNaglowka > rozmiar) {
+    return false;
+  }
+  const char* naglowek = dane + przesuniecie;
+  if (naglowek[24] == 0) {
+    return false;
+  }
+  uint32_t dlugosc = 0;
+  std::memcpy(&dlugosc, naglowek + 8, sizeof(dlugosc));
+  if (dlugosc > rozmiar - przesuniecie - kRozmiarNaglowka) {
+    return false;
+  }
+  rekord->typ = static_cast<TypRekordu>(naglowek[24]);
+  std::memcpy(&rekord->czas_us, naglowek, sizeof(rekord->czas_us));
+  std::memcpy(&rekord->id_pokoju, naglowek + 12, sizeof(rekord->id_pokoju));
+  std::memcpy(&rekord->id_nadawcy, naglowek + 16, sizeof(rekord->id_nadawcy));
+  std::memcpy(&rekord->id_odbiorcy, naglowek + 20, sizeof(rekord->id_odbiorcy));
+  rekord->tresc = std::string_view(naglowek + kRozmiarNaglowka, dlugosc);
+  *nastepny = std::min(rozmiar, przesuniecie + wyrownaj(kRozmiarNaglowka + dlugosc));
+  return true;
+}
+
+class Magazyn {
+ public:
+  Magazyn() = default;
+  Magazyn(const Magazyn&) = delete;
+  Magazyn& operator=(const Magazyn&) = delete;
+
+  ~Magazyn() { zamknij(); }
+
+  bool otworz(const std::string& katalog, size_t rozmiar_segmentu, bool tylko_odczyt) {
+#ifdef _WIN32
+    (void)katalog;
+    (void)rozmiar_segmentu;
+    (void)tylko_odczyt;
+    return false;
+#else
+    katalog_ = katalog;
+    rozmiar_segmentu_ = std::max(rozmiar_segmentu, kMinimalnyRozmiarSegmentu);
+    tylko_odczyt_ = tylko_odczyt;
+    if (!tylko_odczyt_ && mkdir(katalog_.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (!wczytaj_slownik()) {
+      return false;
+    }
+    std::vector<uint64_t> numery = znajdz_segmenty();
+    for (size_t i = 0; i < numery.size(); ++i) {
+      bool ostatni = i + 1 == numery.size();
+      std::unique_ptr<Segment> segment = mapuj(numery[i], ostatni && !tylko_odczyt_);
+      if (!segment) {
+        return false;
+      }
+      if (ostatni || !wczytaj_indeks(*segment)) {
+        zbuduj_indeks(*segment);
+      }
+      segmenty_.push_back(std::move(segment));
+    }
+    if (!tylko_odczyt_ && segmenty_.empty() && !nowy_segment()) {
+      return false;
+    }
+    otwarty_ = true;
+    return true;
+#endif
+  }
+
+  void zamknij() {
+#ifndef _WIN32
+    std::unique_lock<std::shared_mutex> blokada(mutex_);
+    segmenty_.clear();
+    if (deskryptor_slownika_ >= 0) {
+      ::close(deskryptor_slownika_);
+      deskryptor_slownika_ = -1;
+    }
+#endif
+    otwarty_ = false;
+  }
+
+  bool otwarty() const { return otwarty_; }
+
+  bool zna(TypRekordu typ, uint32_t id) const {
+    const std::vector<std::string>& nazwy = nazwy_dla(typ);
+    return id < nazwy.size() && !nazwy[id].empty();
+  }
+
+  const std::vector<std::string>& nazwy_pokoi() const { return nazwy_pokoi_; }
+  const std::vector<std::string>& nazwy_uzytkownikow() const { return nazwy_uzytkownikow_; }
+
+  void zdefiniuj(TypRekordu typ, uint32_t id, std::string_view nazwa) {
+#ifndef _WIN32
+    if (id == 0 || nazwa.empty() || deskryptor_slownika_ < 0 || zna(typ, id)) {
+      return;
+    }
+    Rekord rekord;
+    rekord.typ = typ;
+    if (typ == TypRekordu::DefinicjaPokoju) {
+      rekord.id_pokoju = id;
+    } else {
+      rekord.id_nadawcy = id;
+    }
+    rekord.tresc = nazwa;
+    std::string dane(wyrownaj(kRozmiarNaglowka + nazwa.size()), '\0');
+    zakoduj_naglowek(rekord, &dane[0]);
+    std::memcpy(&dane[kRozmiarNaglowka], nazwa.data(), nazwa.size());
+    if (::write(deskryptor_slownika_, dane.data(), dane.size()) ==
+        static_cast<ssize_t>(dane.size())) {
+      zapamietaj_nazwe(rekord);
+    }
+#else
+    (void)typ;
+    (void)id;
+    (void)nazwa;
+#endif
+  }
+
+  bool dopisz(const Rekord& rekord) {
+#ifdef _WIN32
+    (void)rekord;
+    return false;
+#else
+    if (!otwarty_ || tylko_odczyt_ || rekord.typ == static_cast<TypRekordu>(0)) {
+      return false;
+    }
+    size_t potrzebne = wyrownaj(kRozmiarNaglowka + rekord.tresc.size());
+    Segment* segment = segmenty_.back().get();
+    size_t przesuniecie = segment->koniec.load(std::memory_order_relaxed);
+    if (przesuniecie + potrzebne > segment->rozmiar) {
+      if (potrzebne > rozmiar_segmentu_) {
+        return false;
+      }
+      zapisz_indeks(*segment);
+      if (!nowy_segment()) {
+        return false;
+      }
+      segment = segmenty_.back().get();
+      przesuniecie = 0;
+    }
+    char* cel = segment->dane + przesuniecie;
+    std::memcpy(cel + kRozmiarNaglowka, rekord.tresc.data(), rekord.tresc.size());
+    zakoduj_naglowek(rekord, cel);
+    zaindeksuj(*segment, rekord, przesuniecie);
+    segment->koniec.store(przesuniecie + potrzebne, std::memory_order_release);
+    return true;
+#endif
+  }
+
+  void zsynchronizuj() {
+#ifndef _WIN32
+    if (!otwarty_ || tylko_odczyt_) {
+      return;
+    }
+    const Segment& segment = *segmenty_.back();
+    msync(segment.dane, segment.koniec.load(std::memory_order_relaxed), MS_SYNC);
+    fsync(deskryptor_slownika_);
+#endif
+  }
+
+  template <typename Obsluga>
+  size_t ostatnie_w_pokoju(uint32_t id_pokoju,
+                           int64_t od_us,
+                           int64_t przed_us,
+                           size_t pomin,
+                           size_t ile,
+                           Obsluga&& obsluz) const {
+    std::shared_lock<std::shared_mutex> blokada(mutex_);
+    std::vector<Rekord> znalezione;
+    std::vector<Rekord> z_bloku;
+    bool dalej = true;
+    for (auto segment = segmenty_.rbegin();
+         segment != segmenty_.rend() && dalej && znalezione.size() < pomin + ile; ++segment) {
+      auto pokoj = (*segment)->bloki_pokoi.find(id_pokoju);
+      if (pokoj == (*segment)->bloki_pokoi.end()) {
+        continue;
+      }
+      const std::vector<uint32_t>& bloki = pokoj->second;
+      for (auto blok = bloki.rbegin();
+           blok != bloki.rend() && dalej && znalezione.size() < pomin + ile; ++blok) {
+        if ((*segment)->bloki[*blok].czas_us >= przed_us) {
+          continue;
+        }
+        z_bloku.clear();
+        przegladaj_blok(**segment, *blok, [&](const Rekord& rekord) {
+          if (rekord.typ == TypRekordu::WiadomoscPokoju && rekord.id_pokoju == id_pokoju &&
+              rekord.czas_us >= od_us && rekord.czas_us < przed_us) {
+            z_bloku.push_back(rekord);
+          }
+          return true;
+        });
+        znalezione.insert(znalezione.end(), z_bloku.rbegin(), z_bloku.rend());
+        dalej = (*segment)->bloki[*blok].czas_us >= od_us;
+      }
+    }
+    if (znalezione.size() <= pomin) {
+      return 0;
+    }
+    size_t koniec = std::min(znalezione.size(), pomin + ile);
+    for (size_t i = koniec; i > pomin; --i) {
+      obsluz(znalezione[i - 1]);
+    }
+    return koniec - pomin;
+  }
+
+  template <typename Obsluga>
+  void przegladaj(int64_t od_us, int64_t do_us, uint32_t id_pokoju, Obsluga&& obsluz) const {
+    std::shared_lock<std::shared_mutex> blokada(mutex_);
+    auto segment = segmenty_.begin();
+    if (!segmenty_.empty()) {
+      segment = std::partition_point(
+                    segmenty_.begin() + 1, segmenty_.end(),
+                    [&](const std::unique_ptr<Segment>& nastepny) {
+                      return !nastepny->bloki.empty() && nastepny->bloki.front().czas_us < od_us;
+                    }) -
+                1;
+    }
+    bool dalej = true;
+    auto w_zakresie = [&](const Rekord& rekord) {
+      if (rekord.czas_us > do_us) {
+        dalej = false;
+        return false;
+      }
+      if (rekord.czas_us >= od_us && (id_pokoju == 0 || rekord.id_pokoju == id_pokoju)) {
+        obsluz(rekord);
+      }
+      return true;
+    };
+    for (; segment != segmenty_.end() && dalej; ++segment) {
+      const std::vector<Blok>& bloki = (*segment)->bloki;
+      auto po = std::lower_bound(bloki.begin(), bloki.end(), od_us,
+                                 [](const Blok& blok, int64_t czas) { return blok.czas_us < czas; });
+      uint32_t pierwszy = static_cast<uint32_t>(po == bloki.begin() ? 0 : po - bloki.begin() - 1);
+      if (id_pokoju == 0) {
+        for (uint32_t blok = pierwszy; blok < bloki.size() && dalej; ++blok) {
+          przegladaj_blok(**segment, blok, w_zakresie);
+        }
+        continue;
+      }
+      auto pokoj = (*segment)->bloki_pokoi.find(id_pokoju);
+      if (pokoj == (*segment)->bloki_pokoi.end()) {
+        continue;
+      }
+      const std::vector<uint32_t>& bloki_pokoju = pokoj->second;
+      for (auto blok = std::lower_bound(bloki_pokoju.begin(), bloki_pokoju.end(), pierwszy);
+           blok != bloki_pokoju.end() && dalej; ++blok) {
+        przegladaj_blok(**segment, *blok, w_zakresie);
+      }
+    }
+  }
+
+ private:
+  struct Blok {
+    int64_t czas_us;
+    uint32_t przesuniecie;
+  };
+
+  struct Segment {
+#ifndef _WIN32
+    ~Segment() {
+      if (dane) {
+        munmap(dane, rozmiar);
+      }
+      if (deskryptor >= 0) {
+        ::close(deskryptor);
+      }
+    }
+#endif
+
+    uint64_t numer = 0;
+    int deskryptor = -1;
+    char* dane = nullptr;
+    size_t rozmiar = 0;
+    std::atomic<size_t> koniec{0};
+    std::vector<Blok> bloki;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> bloki_pokoi;
+  };
+
+  const std::vector<std::string>& nazwy_dla(TypRekordu typ) const {
+    return typ == TypRekordu::DefinicjaPokoju ? nazwy_pokoi_ : nazwy_uzytkownikow_;
+  }
+
+  void zapamietaj_nazwe(const Rekord& rekord) {
+    bool pokoj = rekord.typ == TypRekordu::DefinicjaPokoju;
+    std::vector<std::string>& nazwy = pokoj ? nazwy_pokoi_ : nazwy_uzytkownikow_;
+    uint32_t id = pokoj ? rekord.id_pokoju : rekord.id_nadawcy;
+    if (id == 0) {
+      return;
+    }
+    if (id >= nazwy.size()) {
+      nazwy.resize(id + 1);
+    }
+    nazwy[id].assign(rekord.tresc);
+  }
+
+  std::string sciezka_segmentu(uint64_t numer, const char* rozszerzenie) const {
+    char nazwa[32];
+    std::snprintf(nazwa, sizeof(nazwa), "/segment-%08llu.%s",
+                  static_cast<unsigned long long>(numer), rozszerzenie);
+    return katalog_ + nazwa;
+  }
+
+  template <typename Obsluga>
+  void przegladaj_blok(const Segment& segment, uint32_t blok, Obsluga&& obsluz) const {
+    size_t przesuniecie = segment.bloki[blok].przesuniecie;
+    size_t koniec = blok + 1 < segment.bloki.size()
+                        ? segment.bloki[blok + 1].przesuniecie
+                        : segment.koniec.load(std::memory_order_acquire);
+    Rekord rekord;
+    while (przesuniecie < koniec &&
+           odczytaj_rekord(segment.dane, koniec, przesuniecie, &rekord, &przesuniecie)) {
+      if (!obsluz(rekord)) {
+        return;
+      }
+    }
+  }
+
+  void zaindeksuj(Segment& segment, const Rekord& rekord, size_t przesuniecie) {
+    bool nowy_blok = segment.bloki.empty() ||
+                     segment.bloki.back().przesuniecie / kRozmiarBloku != przesuniecie / kRozmiarBloku;
+    uint32_t indeks = static_cast<uint32_t>(segment.bloki.size() - (nowy_blok ? 0 : 1));
+    bool nowy_pokoj = false;
+    if (rekord.id_pokoju != 0) {
+      auto pokoj = segment.bloki_pokoi.find(rekord.id_pokoju);
+      nowy_pokoj = pokoj == segment.bloki_pokoi.end() || pokoj->second.back() != indeks;
+    }
+    if (!nowy_blok && !nowy_pokoj) {
+      return;
+    }
+    std::unique_lock<std::shared_mutex> blokada(mutex_);
+    if (nowy_blok) {
+      segment.bloki.push_back({rekord.czas_us, static_cast<uint32_t>(przesuniecie)});
+    }
+    if (nowy_pokoj) {
+      segment.bloki_pokoi[rekord.id_pokoju].push_back(indeks);
+    }
+  }
+
+  void zbuduj_indeks(Segment& segment) {
+    size_t przesuniecie = 0;
+    size_t nastepny = 0;
+    Rekord rekord;
+    while (odczytaj_rekord(segment.dane, segment.rozmiar, przesuniecie, &rekord, &nastepny)) {
+      zaindeksuj(segment, rekord, przesuniecie);
+      przesuniecie = nastepny;
+    }
+    segment.koniec.store(przesuniecie, std::memory_order_release);
+  }
+
+#ifndef _WIN32
+  bool wczytaj_slownik() {
+    std::string sciezka = katalog_ + "/slownik.dat";
+    std::string dane;
+    if (std::FILE* plik = std::fopen(sciezka.c_str(), "rb")) {
+      char bufor[64 * 1024];
+      size_t przeczytano = 0;
+      while ((przeczytano = std::fread(bufor, 1, sizeof(bufor), plik)) > 0) {
+        dane.append(bufor, przeczytano);
+      }
+      std::fclose(plik);
+    }
+    size_t przesuniecie = 0;
+    size_t nastepny = 0;
+    Rekord rekord;
+    while (odczytaj_rekord(dane.data(), dane.size(), przesuniecie, &rekord, &nastepny)) {
+      zapamietaj_nazwe(rekord);
+      przesuniecie = nastepny;
+    }
+    if (tylko_odczyt_) {
+      return true;
+    }
+    deskryptor_slownika_ = ::open(sciezka.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (deskryptor_slownika_ < 0) {
+      return false;
+    }
+    return przesuniecie == dane.size() ||
+           ftruncate(deskryptor_slownika_, static_cast<off_t>(przesuniecie)) == 0;
+  }
+
+  std::vector<uint64_t> znajdz_segmenty() const {
+    std::vector<uint64_t> numery;
+    DIR* katalog = opendir(katalog_.c_str());
+    if (!katalog) {
+      return numery;
+    }
+    while (dirent* wpis = readdir(katalog)) {
+      unsigned long long numer = 0;
+      char rozszerzenie[8] = {};
+      if (std::sscanf(wpis->d_name, "segment-%llu.%7s", &numer, rozszerzenie) == 2 &&
+          std::strcmp(rozszerzenie, "dat") == 0) {
+        numery.push_back(numer);
+      }
+    }
+    closedir(katalog);
+    std::sort(numery.begin(), numery.end());
+    return numery;
+  }
+
+  std::unique_ptr<Segment> mapuj(uint64_t numer, bool do_zapisu) const {
+    std::string sciezka = sciezka_segmentu(numer, "dat");
+    int deskryptor = ::open(sciezka.c_str(), do_zapisu ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (deskryptor < 0) {
+      return nullptr;
+    }
+    auto segment = std::make_unique<Segment>();
+    segment->numer = numer;
+    segment->deskryptor = deskryptor;
+    struct stat stan {};
+    if (fstat(deskryptor, &stan) != 0) {
+      return nullptr;
+    }
+    segment->rozmiar = static_cast<size_t>(stan.st_size);
+    if (do_zapisu && segment->rozmiar == 0) {
+      if (ftruncate(deskryptor, static_cast<off_t>(rozmiar_segmentu_)) != 0) {
+        return nullptr;
+      }
+      segment->rozmiar = rozmiar_segmentu_;
+    }
+    if (segment->rozmiar == 0) {
+      return segment;
+    }
+    void* dane = mmap(nullptr, segment->rozmiar, do_zapisu ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, deskryptor, 0);
+    if (dane == MAP_FAILED) {
+      return nullptr;
+    }
+    segment->dane = static_cast<char*>(dane);
+    return segment;
+  }
+
+  bool nowy_segment() {
+    uint64_t numer = segmenty_.empty() ? 1 : segmenty_.back()->numer + 1;
+    std::unique_ptr<Segment> segment = mapuj(numer, true);
+    if (!segment) {
+      return false;
+    }
+    std::unique_lock<std::shared_mutex> blokada(mutex_);
+    segmenty_.push_back(std::move(segment));
+    return true;
+  }
+
+  void zapisz_indeks(const Segment& segment) const {
+    std::string sciezka = sciezka_segmentu(segment.numer, "idx");
+    std::string tymczasowa = sciezka + ".tmp";
+    std::FILE* plik = std::fopen(tymczasowa.c_str(), "wb");
+    if (!plik) {
+      return;
+    }
+    auto zapisz = [&](const void* dane, size_t rozmiar) { std::fwrite(dane, 1, rozmiar, plik); };
+    uint64_t koniec = segment.koniec.load(std::memory_order_relaxed);
+    uint64_t liczba_blokow = segment.bloki.size();
+    zapisz(&koniec, sizeof(koniec));
+    zapisz(&liczba_blokow, sizeof(liczba_blokow));
+    for (const Blok& blok : segment.bloki) {
+      zapisz(&blok.czas_us, sizeof(blok.czas_us));
+      zapisz(&blok.przesuniecie, sizeof(blok.przesuniecie));
+    }
+    uint64_t liczba_pokoi = segment.bloki_pokoi.size();
+    zapisz(&liczba_pokoi, sizeof(liczba_pokoi));
+    for (const auto& [id_pokoju, bloki] : segment.bloki_pokoi) {
+      uint32_t liczba = static_cast<uint32_t>(bloki.size());
+      zapisz(&id_pokoju, sizeof(id_pokoju));
+      zapisz(&liczba, sizeof(liczba));
+      zapisz(bloki.data(), bloki.size() * sizeof(uint32_t));
+    }
+    bool poprawny = std::ferror(plik) == 0;
+    poprawny = std::fclose(plik) == 0 && poprawny;
+    if (!poprawny || std::rename(tymczasowa.c_str(), sciezka.c_str()) != 0) {
+      std::remove(tymczasowa.c_str());
+    }
+  }
+
+  bool wczytaj_indeks(Segment& segment) const {
+    std::string sciezka = sciezka_segmentu(segment.numer, "idx");
+    std::FILE* plik = std::fopen(sciezka.c_str(), "rb");
+    if (!plik) {
+      return false;
+    }
+    auto wczytaj = [&](void* dane, size_t rozmiar) {
+      return std::fread(dane, 1, rozmiar, plik) == rozmiar;
+    };
+    uint64_t koniec = 0;
+    uint64_t liczba_blokow = 0;
+    bool poprawny = wczytaj(&koniec, sizeof(koniec)) && koniec <= segment.rozmiar &&
+                    wczytaj(&liczba_blokow, sizeof(liczba_blokow)) &&
+                    liczba_blokow <= segment.rozmiar / kRozmiarNaglowka;
+    for (uint64_t i = 0; poprawny && i < liczba_blokow; ++i) {
+      Blok blok{};
+      poprawny = wczytaj(&blok.czas_us, sizeof(blok.czas_us)) &&
+                 wczytaj(&blok.przesuniecie, sizeof(blok.przesuniecie)) &&
+                 blok.przesuniecie < koniec;
+      segment.bloki.push_back(blok);
+    }
+    uint64_t liczba_pokoi = 0;
+    poprawny = poprawny && wczytaj(&liczba_pokoi, sizeof(liczba_pokoi));
+    for (uint64_t i = 0; poprawny && i < liczba_pokoi; ++i) {
+      uint32_t id_pokoju = 0;
+      uint32_t liczba = 0;
+      poprawny = wczytaj(&id_pokoju, sizeof(id_pokoju)) && wczytaj(&liczba, sizeof(liczba)) &&
+                 liczba <= liczba_blokow;
+      if (!poprawny) {
+        break;
+      }
+      std::vector<uint32_t>& bloki = segment.bloki_pokoi[id_pokoju];
+      bloki.resize(liczba);
+      poprawny = wczytaj(bloki.data(), liczba * sizeof(uint32_t)) &&
+                 std::all_of(bloki.begin(), bloki.end(),
+                             [&](uint32_t blok) { return blok < liczba_blokow; });
+    }
+    std::fclose(plik);
+    if (!poprawny) {
+      segment.bloki.clear();
+      segment.bloki_pokoi.clear();
+      return false;
+    }
+    segment.koniec.store(static_cast<size_t>(koniec), std::memory_order_release);
+    return true;
+  }
+#endif
+
+  std::string katalog_;
+  size_t rozmiar_segmentu_ = kMinimalnyRozmiarSegmentu;
+  bool tylko_odczyt_ = false;
+  bool otwarty_ = false;
+  int deskryptor_slownika_ = -1;
+  std::vector<std::string> nazwy_pokoi_;
+  std::vector<std::string> nazwy_uzytkownikow_;
+  mutable std::shared_mutex mutex_;
+  std::vector<std::unique_ptr<Segment>> segmenty_;
+};
+
+}  // namespace magazyn
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef CHATAPP_METRYKI_HPP
+#define CHATAPP_METRYKI_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace metryki {
+
+constexpr size_t kLiczbaSlotow = 16;
+constexpr size_t kLiczbaKubelkow = 40;
+
+inline size_t slot_watku() {
+  static std::atomic<size_t> nastepny{0};
+  thread_local size_t slot = nastepny.fetch_add(1, std::memory_order_relaxed) % kLiczbaSlotow;
+  return slot;
+}
+
+inline size_t szerokosc_bitowa(uint64_t wartosc) {
+#if defined(__GNUC__) || defined(__clang__)
+  return wartosc == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(wartosc));
+#else
+  size_t wynik = 0;
+  while (wartosc != 0) {
+    ++wynik;
+    wartosc >>= 1;
+  }
+  return wynik;
+#endif
+}
+
+class Licznik {
+ public:
+  void dodaj(uint64_t ile = 1) {
+    sloty_[slot_watku()].wartosc.fetch_add(ile, std::memory_order_relaxed);
+  }
+
+  uint64_t wartosc() const {
+    uint64_t suma = 0;
+    for (const Slot& slot : sloty_) {
+      suma += slot.wartosc.load(std::memory_order_relaxed);
+    }
+    return suma;
+  }
+
+ private:
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> wartosc{0};
+  };
+
+  std::array<Slot, kLiczbaSlotow> sloty_;
+};
+
+class Histogram {
+ public:
+  struct Stan {
+    std::array<uint64_t, kLiczbaKubelkow> kubelki{};
+    uint64_t liczba = 0;
+    uint64_t suma = 0;
+  };
+
+  void zapisz(uint64_t wartosc) {
+    Slot& slot = sloty_[slot_watku()];
+    size_t kubelek = szerokosc_bitowa(wartosc);
+    if (kubelek >= kLiczbaKubelkow) {
+      kubelek = kLiczbaKubelkow - 1;
+    }
+    slot.kubelki[kubelek].fetch_add(1, std::memory_order_relaxed);
+    slot.suma.fetch_add(wartosc, std::memory_order_relaxed);
+  }
+
+  void zapisz_czas(std::chrono::steady_clock::time_point start) {
+    zapisz(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count()));
+  }
+
+  Stan stan() const {
+    Stan wynik;
+    for (const Slot& slot : sloty_) {
+      for (size_t i = 0; i < kLiczbaKubelkow; ++i) {
+        uint64_t liczba = slot.kubelki[i].load(std::memory_order_relaxed);
+        wynik.kubelki[i] += liczba;
+        wynik.liczba += liczba;
+      }
+      wynik.suma += slot.suma.load(std::memory_order_relaxed);
+    }
+    return wynik;
+  }
+
+ private:
+  struct alignas(64) Slot {
+    std::array<std::atomic<uint64_t>, kLiczbaKubelkow> kubelki{};
+    std::atomic<uint64_t> suma{0};
+  };
+
+  std::array<Slot, kLiczbaSlotow> sloty_;
+};
+
+inline uint64_t kwantyl(const Histogram::Stan& stan, double ulamek) {
+  if (stan.liczba == 0) {
+    return 0;
+  }
+  uint64_t prog = static_cast<uint64_t>(ulamek * static_cast<double>(stan.liczba));
+  uint64_t narastajaco = 0;
+  for (size_t i = 0; i < kLiczbaKubelkow; ++i) {
+    narastajaco += stan.kubelki[i];
+    if (narastajaco > prog) {
+      return i == 0 ? 0 : (uint64_t{1} << i) - 1;
+    }
+  }
+  return (uint64_t{1} << (kLiczbaKubelkow - 1)) - 1;
+}
+
+inline void dopisz_naglowek(std::string* cel,
+                            std::string_view nazwa,
+                            std::string_view opis,
+                            std::string_view typ) {
+  cel->append("# HELP ").append(nazwa).append(" ").append(opis).append("\n");
+  cel->append("# TYPE ").append(nazwa).append(" ").append(typ).append("\n");
+}
+
+inline void dopisz_licznik(std::string* cel,
+                           std::string_view nazwa,
+                           std::string_view opis,
+                           uint64_t wartosc) {
+  dopisz_naglowek(cel, nazwa, opis, "counter");
+  cel->append(nazwa).append(" ").append(std::to_string(wartosc)).append("\n");
+}
+
+inline void dopisz_miernik(std::string* cel,
+                           std::string_view nazwa,
+                           std::string_view opis,
+                           uint64_t wartosc) {
+  dopisz_naglowek(cel, nazwa, opis, "gauge");
+  cel->append(nazwa).append(" ").append(std::to_string(wartosc)).append("\n");
+}
+
+inline void dopisz_histogram(std::string* cel,
+                             std::string_view nazwa,
+                             std::string_view opis,
+                             const Histogram& histogram,
+                             double skala = 1.0) {
+  Histogram::Stan stan = histogram.stan();
+  dopisz_naglowek(cel, nazwa, opis, "histogram");
+  uint64_t narastajaco = 0;
+  for (size_t i = 0; i + 1 < kLiczbaKubelkow; ++i) {
+    narastajaco += stan.kubelki[i];
+    double granica = static_cast<double>(i == 0 ? 0 : (uint64_t{1} << i) - 1) * skala;
+    char tekst[32];
+    std::snprintf(tekst, sizeof(tekst), "%.9g", granica);
+    cel->append(nazwa).append("_bucket{le=\"").append(tekst).append("\"} ");
+    cel->append(std::to_string(narastajaco)).append("\n");
+  }
+  cel->append(nazwa).append("_bucket{le=\"+Inf\"} ").append(std::to_string(stan.liczba));
+  cel->append("\n");
+  char suma[32];
+  std::snprintf(suma, sizeof(suma), "%.9g", static_cast<double>(stan.suma) * skala);
+  cel->append(nazwa).append("_sum ").append(suma).append("\n");
+  cel->append(nazwa).append("_count ").append(std::to_string(stan.liczba)).append("\n");
+}
+
+}  // namespace metryki
+
+#endif
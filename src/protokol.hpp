@@ -0,0 +1,120 @@
+#ifndef CHATAPP_PROTOKOL_HPP
+#define CHATAPP_PROTOKOL_HPP
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace protokol {
+
+constexpr std::string_view kNazwaBinarnego = "binary";
+
+enum class TypRamki : uint8_t {
+  Tekst = 1,
+  WiadomoscPokoju = 2,
+  WiadomoscPrywatna = 3,
+  DefinicjaUzytkownika = 4,
+  DefinicjaPokoju = 5,
+};
+
+inline void dopisz_varint(std::string* cel, uint64_t wartosc) {
+  while (wartosc >= 0x80) {
+    cel->push_back(static_cast<char>((wartosc & 0x7f) | 0x80));
+    wartosc >>= 7;
+  }
+  cel->push_back(static_cast<char>(wartosc));
+}
+
+inline bool odczytaj_varint(std::string_view* dane, uint64_t* wartosc) {
+  uint64_t wynik = 0;
+  for (size_t i = 0; i < dane->size() && i < 10; ++i) {
+    uint8_t bajt = static_cast<uint8_t>((*dane)[i]);
+    wynik |= static_cast<uint64_t>(bajt & 0x7f) << (7 * i);
+    if ((bajt & 0x80) == 0) {
+      dane->remove_prefix(i + 1);
+      *wartosc = wynik;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void dopisz_ramke(std::string* cel,
+                         TypRamki typ,
+                         std::initializer_list<uint64_t> identyfikatory,
+                         std::string_view tresc) {
+  std::string naglowek;
+  for (uint64_t identyfikator : identyfikatory) {
+    dopisz_varint(&naglowek, identyfikator);
+  }
+  cel->push_back(static_cast<char>(typ));
+  dopisz_varint(cel, naglowek.size() + tresc.size());
+  cel->append(naglowek);
+  cel->append(tresc);
+}
+
+inline void dopisz_ramki_tekstowe(std::string* cel, std::string_view tekst) {
+  while (!tekst.empty()) {
+    size_t koniec = tekst.find('\n');
+    std::string_view linia = tekst.substr(0, koniec);
+    if (!linia.empty()) {
+      dopisz_ramke(cel, TypRamki::Tekst, {}, linia);
+    }
+    if (koniec == std::string_view::npos) {
+      break;
+    }
+    tekst.remove_prefix(koniec + 1);
+  }
+}
+
+class DekoderRamek {
+ public:
+  template <typename Obsluga>
+  bool przyjmij(const char* dane, size_t rozmiar, size_t maks_rozmiar, Obsluga&& obsluz) {
+    if (reszta_.empty()) {
+      std::string_view widok(dane, rozmiar);
+      if (!dekoduj(&widok, maks_rozmiar, obsluz)) {
+        return false;
+      }
+      reszta_.assign(widok.data(), widok.size());
+      return true;
+    }
+    reszta_.append(dane, rozmiar);
+    std::string_view widok(reszta_);
+    if (!dekoduj(&widok, maks_rozmiar, obsluz)) {
+      return false;
+    }
+    reszta_.erase(0, reszta_.size() - widok.size());
+    return true;
+  }
+
+ private:
+  template <typename Obsluga>
+  static bool dekoduj(std::string_view* dane, size_t maks_rozmiar, Obsluga& obsluz) {
+    while (dane->size() >= 2) {
+      std::string_view po_typie = dane->substr(1);
+      uint64_t dlugosc = 0;
+      if (!odczytaj_varint(&po_typie, &dlugosc)) {
+        return po_typie.size() < 10;
+      }
+      if (dlugosc > maks_rozmiar) {
+        return false;
+      }
+      if (po_typie.size() < dlugosc) {
+        return true;
+      }
+      auto typ = static_cast<TypRamki>((*dane)[0]);
+      std::string_view ladunek = po_typie.substr(0, static_cast<size_t>(dlugosc));
+      *dane = po_typie.substr(static_cast<size_t>(dlugosc));
+      obsluz(typ, ladunek);
+    }
+    return true;
+  }
+
+  std::string reszta_;
+};
+
+}  // namespace protokol
+
+#endif
@@ -1,28 +1,61 @@
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <io.h>
 #else
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <poll.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
-#include <fstream>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "blokady.hpp"
+#include "komendy.hpp"
+#include "kompresja.hpp"
+#include "limity.hpp"
+#include "magazyn.hpp"
+#include "metryki.hpp"
+#include "protokol.hpp"
+#include "zbiory.hpp"
+
 namespace {
 using UchwytGniazda =
 #ifdef _WIN32
@@ -52,29 +85,475 @@ constexpr UchwytGniazda kNieprawidloweGniazdo =
     -1;
 #endif
 
+template <typename Klucz, typename Wartosc>
+class RejestrShardowany {
+ public:
+  static constexpr size_t kLiczbaShardow = 64;
+
+  explicit RejestrShardowany(blokady::Profil& profil)
+      : shardy_(zbuduj_shardy(profil, std::make_index_sequence<kLiczbaShardow>{})) {}
+
+  template <typename Funkcja>
+  auto czytaj(const Klucz& klucz,
+              Funkcja&& funkcja,
+              const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA) const {
+    const Shard& shard = shard_dla(klucz);
+    blokady::Wspoldzielona<std::shared_mutex> blokada(shard.mutex, miejsce);
+    auto iter = shard.mapa.find(klucz);
+    return funkcja(iter == shard.mapa.end() ? nullptr : &iter->second);
+  }
+
+  template <typename Funkcja>
+  auto zmien(const Klucz& klucz,
+             Funkcja&& funkcja,
+             const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA) {
+    Shard& shard = shard_dla(klucz);
+    blokady::Wylaczna<std::shared_mutex> blokada(shard.mutex, miejsce);
+    return funkcja(shard.mapa);
+  }
+
+  template <typename Funkcja>
+  void dla_kazdego(Funkcja&& funkcja, const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA) const {
+    for (const Shard& shard : shardy_) {
+      blokady::Wspoldzielona<std::shared_mutex> blokada(shard.mutex, miejsce);
+      for (const auto& [klucz, wartosc] : shard.mapa) {
+        funkcja(klucz, wartosc);
+      }
+    }
+  }
+
+  size_t rozmiar(const char* miejsce = CHATAPP_MIEJSCE_WYWOLANIA) const {
+    size_t wynik = 0;
+    for (const Shard& shard : shardy_) {
+      blokady::Wspoldzielona<std::shared_mutex> blokada(shard.mutex, miejsce);
+      wynik += shard.mapa.size();
+    }
+    return wynik;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    explicit Shard(blokady::Profil& profil) : mutex(profil) {}
+
+    mutable blokady::Mutex<std::shared_mutex> mutex;
+    std::unordered_map<Klucz, Wartosc> mapa;
+  };
+
+  template <size_t... Indeksy>
+  static std::array<Shard, kLiczbaShardow> zbuduj_shardy(blokady::Profil& profil,
+                                                         std::index_sequence<Indeksy...>) {
+    return {{((void)Indeksy, Shard(profil))...}};
+  }
+
+  const Shard& shard_dla(const Klucz& klucz) const {
+    return shardy_[std::hash<Klucz>{}(klucz) % kLiczbaShardow];
+  }
+
+  Shard& shard_dla(const Klucz& klucz) {
+    return shardy_[std::hash<Klucz>{}(klucz) % kLiczbaShardow];
+  }
+
+  std::array<Shard, kLiczbaShardow> shardy_;
+};
+
+struct MetrykiSerwera {
+  metryki::Licznik polaczenia_otwarte;
+  metryki::Licznik polaczenia_zamkniete;
+  metryki::Licznik wiadomosci_przychodzace;
+  metryki::Licznik wiadomosci_wychodzace;
+  metryki::Licznik bajty_przychodzace;
+  metryki::Licznik bajty_wychodzace;
+  metryki::Histogram odbiorcy_rozglaszania;
+  metryki::Histogram czas_rozglaszania_ns;
+  metryki::Histogram oczekiwanie_klienci_ns;
+  metryki::Histogram oczekiwanie_pokoje_ns;
+  metryki::Histogram oczekiwanie_logu_ns;
+  metryki::Licznik zdarzenia_obecnosci;
+  metryki::Licznik paczki_obecnosci;
+  metryki::Licznik ograniczone_polaczenia;
+  metryki::Licznik ograniczone_pokoje;
+  metryki::Licznik ograniczone_prywatne;
+  metryki::Licznik wywolania_wysylki;
+};
+
+MetrykiSerwera metryki_serwera;
+
+blokady::Profil profil_klientow("klienci", &metryki_serwera.oczekiwanie_klienci_ns);
+blokady::Profil profil_polaczen("polaczenia", &metryki_serwera.oczekiwanie_klienci_ns);
+blokady::Profil profil_rejestru_pokoi("pokoje", &metryki_serwera.oczekiwanie_pokoje_ns);
+blokady::Profil profil_pokoju("czlonkowie_pokoju", &metryki_serwera.oczekiwanie_pokoje_ns);
+blokady::Profil profil_historii("historia_pokoju");
+blokady::Profil profil_nazw("nazwy");
+blokady::Profil profil_slownikow("slowniki");
+blokady::Profil profil_zegara("zegar_logu");
+blokady::Profil profil_budzenia_logu("budzenie_logu", &metryki_serwera.oczekiwanie_logu_ns);
+blokady::Profil profil_archiwizatora("archiwizator");
+blokady::Profil profil_katalogu("katalog_pokoi");
+blokady::Profil profil_pomiaru_ruchu("pomiar_ruchu");
+blokady::Profil profil_obecnosci("obecnosc");
+blokady::Profil profil_scalacza("scalacz");
+blokady::Profil profil_wysylki_reaktora("wysylka_reaktora");
+blokady::Profil profil_subskrypcji("subskrypcje");
+
 struct InformacjeKlienta {
   UchwytGniazda gniazdo;
   std::string nazwa;
-  std::string pokoj;
 };
 
-struct InformacjePokoju {
+struct UstawieniaHistorii {
+  size_t wiadomosci = 200;
+  size_t bajty = 200 * 256;
+  size_t odtwarzane = 20;
+};
+
+UstawieniaHistorii ustawienia_historii;
+
+struct UstawieniaLimitow {
+  limity::Limit polaczenie;
+  limity::Limit pokoj;
+  limity::Limit prywatne;
+};
+
+UstawieniaLimitow ustawienia_limitow;
+
+class HistoriaPokoju {
+ public:
+  int64_t dopisz(std::string_view linia, int64_t czas_us) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    czas_us = std::max(czas_us, ostatni_us_ + 1);
+    ostatni_us_ = czas_us;
+    if (wpisy_.empty()) {
+      if (ustawienia_historii.wiadomosci == 0) {
+        return czas_us;
+      }
+      wpisy_.resize(ustawienia_historii.wiadomosci);
+      dane_.resize(ustawienia_historii.bajty);
+    }
+    if (linia.size() > dane_.size()) {
+      return czas_us;
+    }
+    while (liczba_ == wpisy_.size() || bajty_ + linia.size() > dane_.size()) {
+      bajty_ -= wpisy_[pierwszy_].dlugosc;
+      pierwszy_ = (pierwszy_ + 1) % wpisy_.size();
+      --liczba_;
+    }
+    size_t poczatek = koniec_;
+    size_t pierwsza_czesc = std::min(linia.size(), dane_.size() - poczatek);
+    std::memcpy(dane_.data() + poczatek, linia.data(), pierwsza_czesc);
+    std::memcpy(dane_.data(), linia.data() + pierwsza_czesc, linia.size() - pierwsza_czesc);
+    koniec_ = (poczatek + linia.size()) % dane_.size();
+    wpisy_[(pierwszy_ + liczba_) % wpisy_.size()] = {poczatek, linia.size(), czas_us};
+    ++liczba_;
+    bajty_ += linia.size();
+    return czas_us;
+  }
+
+  size_t dopisz_strone(size_t pomin,
+                       size_t ile,
+                       std::string* cel,
+                       size_t* wszystkie,
+                       int64_t* najstarszy_us) const {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    *wszystkie = liczba_;
+    *najstarszy_us =
+        liczba_ > 0 ? wpisy_[pierwszy_].czas_us : std::numeric_limits<int64_t>::max();
+    if (pomin >= liczba_) {
+      return 0;
+    }
+    size_t liczba = std::min(ile, liczba_ - pomin);
+    size_t od = liczba_ - pomin - liczba;
+    for (size_t i = od; i < od + liczba; ++i) {
+      const Wpis& wpis = wpisy_[(pierwszy_ + i) % wpisy_.size()];
+      size_t pierwsza_czesc = std::min(wpis.dlugosc, dane_.size() - wpis.poczatek);
+      cel->append(dane_.data() + wpis.poczatek, pierwsza_czesc);
+      cel->append(dane_.data(), wpis.dlugosc - pierwsza_czesc);
+    }
+    return liczba;
+  }
+
+ private:
+  struct Wpis {
+    size_t poczatek;
+    size_t dlugosc;
+    int64_t czas_us;
+  };
+
+  mutable blokady::Mutex<std::mutex> mutex_{profil_historii};
+  std::vector<char> dane_;
+  std::vector<Wpis> wpisy_;
+  size_t pierwszy_ = 0;
+  size_t liczba_ = 0;
+  size_t bajty_ = 0;
+  size_t koniec_ = 0;
+  int64_t ostatni_us_ = 0;
+};
+
+struct Pokoj {
+  uint32_t id;
   std::string nazwa;
   std::string haslo;
   UchwytGniazda wlasciciel;
-  std::unordered_set<UchwytGniazda> czlonkowie;
+  int64_t utworzono_us = 0;
+  mutable blokady::Mutex<std::shared_mutex> mutex{profil_pokoju};
+  bool usuniety = false;
+  zbiory::ZbiorPosortowany<UchwytGniazda> czlonkowie;
+  std::shared_ptr<const std::vector<UchwytGniazda>> migawka_czlonkow;
+  HistoriaPokoju historia;
+  limity::WspolnyKubelek limit;
+};
+
+using UchwytPokoju = std::shared_ptr<Pokoj>;
+
+struct SesjaKlienta {
+  UchwytGniazda gniazdo;
+  std::string nazwa;
+  uint32_t id_uzytkownika = 0;
+  UchwytPokoju pokoj;
+  blokady::Mutex<std::mutex> mutex_subskrypcji{profil_subskrypcji};
+  std::vector<UchwytPokoju> subskrypcje;
+  bool binarny = false;
+  limity::Kubelek limit_wiadomosci;
+  limity::Kubelek limit_prywatnych;
+  uint8_t zgloszone_limity = 0;
 };
 
-std::unordered_map<UchwytGniazda, InformacjeKlienta> klienci;
-std::mutex mutex_klientow;
+RejestrShardowany<UchwytGniazda, InformacjeKlienta> klienci(profil_klientow);
 
-std::unordered_map<std::string, InformacjePokoju> pokoje;
-std::mutex mutex_pokoi;
+std::unordered_map<std::string, UchwytGniazda> indeks_nazw;
+blokady::Mutex<std::shared_mutex> mutex_nazw(profil_nazw);
 
-std::mutex mutex_logu;
-std::ofstream plik_logu;
+RejestrShardowany<std::string, UchwytPokoju> pokoje(profil_rejestru_pokoi);
+UchwytPokoju lobby;
 
 std::atomic<bool> uruchomione{true};
+std::atomic<bool> zamykanie{false};
+bool tryb_reaktora = false;
+
+enum class PolitykaWolnegoOdbiorcy {
+  UsunNajstarsze,
+  Rozlacz,
+  Przeciwcisnienie,
+};
+
+struct UstawieniaKolejek {
+  size_t limit_bajtow = 1024 * 1024;
+  PolitykaWolnegoOdbiorcy polityka = PolitykaWolnegoOdbiorcy::UsunNajstarsze;
+  std::chrono::milliseconds limit_oczekiwania{1000};
+};
+
+struct UstawieniaScalania {
+  std::chrono::milliseconds okno{0};
+  size_t prog_bajtow = 16 * 1024;
+  bool bez_opoznien = false;
+  bool cork = false;
+};
+
+struct LicznikiKolejek {
+  std::atomic<uint64_t> przepelnienia{0};
+  std::atomic<uint64_t> odrzucone_wiadomosci{0};
+  std::atomic<uint64_t> rozlaczenia{0};
+  std::atomic<uint64_t> oczekiwania{0};
+};
+
+using WspolnyBufor = std::shared_ptr<const std::string>;
+
+WspolnyBufor zbuduj_bufor(std::string tresc) {
+  return std::make_shared<const std::string>(std::move(tresc));
+}
+
+struct WynikRamkowania {
+  bool odrzucono = false;
+  size_t zuzyte = 0;
+};
+
+class BuforLinii {
+ public:
+  template <typename Obsluga>
+  WynikRamkowania przyjmij(const char* dane,
+                           size_t rozmiar,
+                           size_t maks_dlugosc,
+                           Obsluga&& obsluz) {
+    WynikRamkowania wynik;
+    const char* const poczatek = dane;
+    const char* koniec = dane + rozmiar;
+    if (!reszta_.empty() || pomijanie_) {
+      const char* nowa_linia = static_cast<const char*>(std::memchr(dane, '\n', rozmiar));
+      if (nowa_linia == nullptr) {
+        dopisz_reszte(dane, rozmiar, maks_dlugosc, &wynik.odrzucono);
+        wynik.zuzyte = rozmiar;
+        return wynik;
+      }
+      dopisz_reszte(dane, static_cast<size_t>(nowa_linia - dane), maks_dlugosc, &wynik.odrzucono);
+      bool dalej = true;
+      if (pomijanie_) {
+        pomijanie_ = false;
+      } else {
+        dalej = obsluz(std::string_view(reszta_));
+      }
+      zwolnij_reszte();
+      dane = nowa_linia + 1;
+      if (!dalej) {
+        wynik.zuzyte = static_cast<size_t>(dane - poczatek);
+        return wynik;
+      }
+    }
+    while (dane < koniec) {
+      const char* nowa_linia =
+          static_cast<const char*>(std::memchr(dane, '\n', static_cast<size_t>(koniec - dane)));
+      if (nowa_linia == nullptr) {
+        dopisz_reszte(dane, static_cast<size_t>(koniec - dane), maks_dlugosc, &wynik.odrzucono);
+        dane = koniec;
+        break;
+      }
+      size_t dlugosc = static_cast<size_t>(nowa_linia - dane);
+      bool dalej = true;
+      if (dlugosc > maks_dlugosc) {
+        wynik.odrzucono = true;
+      } else {
+        dalej = obsluz(std::string_view(dane, dlugosc));
+      }
+      dane = nowa_linia + 1;
+      if (!dalej) {
+        break;
+      }
+    }
+    wynik.zuzyte = static_cast<size_t>(dane - poczatek);
+    return wynik;
+  }
+
+ private:
+  void dopisz_reszte(const char* dane, size_t rozmiar, size_t maks_dlugosc, bool* odrzucono) {
+    if (pomijanie_) {
+      return;
+    }
+    if (reszta_.size() + rozmiar > maks_dlugosc) {
+      zwolnij_reszte();
+      pomijanie_ = true;
+      *odrzucono = true;
+      return;
+    }
+    reszta_.append(dane, rozmiar);
+  }
+
+  void zwolnij_reszte() {
+    if (reszta_.capacity() > kPojemnoscZachowywana) {
+      std::string().swap(reszta_);
+    } else {
+      reszta_.clear();
+    }
+  }
+
+  static constexpr size_t kPojemnoscZachowywana = 4096;
+
+  std::string reszta_;
+  bool pomijanie_ = false;
+};
+
+class Slownik {
+ public:
+  uint32_t identyfikator(const std::string& nazwa) {
+    {
+      blokady::Wspoldzielona<std::shared_mutex> blokada(mutex_);
+      auto iter = identyfikatory_.find(nazwa);
+      if (iter != identyfikatory_.end()) {
+        return iter->second;
+      }
+    }
+    blokady::Wylaczna<std::shared_mutex> blokada(mutex_);
+    auto [iter, nowy] =
+        identyfikatory_.emplace(nazwa, static_cast<uint32_t>(nazwy_.size() + 1));
+    if (nowy) {
+      nazwy_.push_back(nazwa);
+    }
+    return iter->second;
+  }
+
+  void przywroc(uint32_t identyfikator, const std::string& nazwa) {
+    blokady::Wylaczna<std::shared_mutex> blokada(mutex_);
+    if (identyfikator == 0 || nazwa.empty() ||
+        !identyfikatory_.emplace(nazwa, identyfikator).second) {
+      return;
+    }
+    if (identyfikator > nazwy_.size()) {
+      nazwy_.resize(identyfikator);
+    }
+    nazwy_[identyfikator - 1] = nazwa;
+  }
+
+  std::string nazwa(uint32_t identyfikator) const {
+    blokady::Wspoldzielona<std::shared_mutex> blokada(mutex_);
+    if (identyfikator == 0 || identyfikator > nazwy_.size()) {
+      return {};
+    }
+    return nazwy_[identyfikator - 1];
+  }
+
+ private:
+  mutable blokady::Mutex<std::shared_mutex> mutex_{profil_slownikow};
+  std::unordered_map<std::string, uint32_t> identyfikatory_;
+  std::vector<std::string> nazwy_;
+};
+
+Slownik slownik_uzytkownikow;
+Slownik slownik_pokoi;
+
+struct Wiadomosc {
+  Wiadomosc() = default;
+  explicit Wiadomosc(WspolnyBufor tresc) : tekst(std::move(tresc)) {}
+
+  WspolnyBufor tekst;
+  WspolnyBufor ramki;
+  uint32_t id_pokoju = 0;
+  uint32_t id_nadawcy = 0;
+  uint32_t id_odbiorcy = 0;
+};
+
+std::atomic<size_t> liczba_binarnych{0};
+
+bool sa_klienci_binarni() {
+  return liczba_binarnych.load(std::memory_order_relaxed) > 0;
+}
+
+Wiadomosc wiadomosc_tekstowa(std::string tekst) {
+  Wiadomosc wiadomosc;
+  if (sa_klienci_binarni()) {
+    std::string ramki;
+    protokol::dopisz_ramki_tekstowe(&ramki, tekst);
+    wiadomosc.ramki = zbuduj_bufor(std::move(ramki));
+  }
+  wiadomosc.tekst = zbuduj_bufor(std::move(tekst));
+  return wiadomosc;
+}
+
+struct GotoweDoWysylki;
+
+struct Polaczenie : std::enable_shared_from_this<Polaczenie> {
+  SesjaKlienta sesja;
+  BuforLinii wejscie;
+  protokol::DekoderRamek ramki;
+  bool binarny = false;
+  std::unordered_set<uint32_t> znani_uzytkownicy;
+  std::unordered_set<uint32_t> znane_pokoje;
+  std::mutex mutex_wyjscia;
+  std::condition_variable zmiana_kolejki;
+  std::deque<WspolnyBufor> kolejka;
+  size_t bajty_w_kolejce = 0;
+  size_t wyslano_z_pierwszej = 0;
+  bool przepelniona = false;
+  bool zamkniete = false;
+  bool wysylanie = false;
+  std::thread pisarz;
+  GotoweDoWysylki* gotowe = nullptr;
+  bool zaplanowane = false;
+};
+
+UstawieniaKolejek ustawienia_kolejek;
+UstawieniaScalania ustawienia_scalania;
+LicznikiKolejek liczniki_kolejek;
+size_t maks_dlugosc_linii = 8192;
+constexpr size_t kZapasNaglowkaRamki = 32;
+
+RejestrShardowany<UchwytGniazda, std::shared_ptr<Polaczenie>> polaczenia(profil_polaczen);
 
 std::string tekst_bledu_gniazda() {
 #ifdef _WIN32
@@ -92,522 +571,2905 @@ void zamknij_gniazdo(UchwytGniazda gniazdo) {
 #endif
 }
 
-std::string znacznik_czasu_teraz() {
-  std::time_t teraz = std::time(nullptr);
-  char bufor[64];
-  std::strftime(bufor, sizeof(bufor), "%Y-%m-%d %H:%M:%S", std::localtime(&teraz));
-  return bufor;
-}
-
-void zapisz_log(const std::string& wiadomosc) {
-  std::lock_guard<std::mutex> blokada(mutex_logu);
-  plik_logu << "[" << znacznik_czasu_teraz() << "] " << wiadomosc << '\n';
-  plik_logu.flush();
-}
+enum class PrecyzjaZnacznika {
+  Sekundy,
+  Milisekundy,
+  Mikrosekundy,
+};
 
-bool wyslij_wszystko(UchwytGniazda gniazdo, const std::string& wiadomosc) {
-  const char* dane = wiadomosc.c_str();
-  size_t lacznie_wyslano = 0;
-  size_t dlugosc = wiadomosc.size();
-  while (lacznie_wyslano < dlugosc) {
-    RozmiarGniazda wyslano =
-        send(gniazdo, dane + lacznie_wyslano,
-             static_cast<RozmiarGniazda>(dlugosc - lacznie_wyslano), 0);
-    if (wyslano <= 0) {
-      return false;
-    }
-    lacznie_wyslano += static_cast<size_t>(wyslano);
-  }
-  return true;
-}
+class ZegarZnacznikow {
+ public:
+  using Chwila = std::chrono::steady_clock::time_point;
 
-void rozglos_wiadomosc(const std::string& wiadomosc,
-                       UchwytGniazda wyklucz_gniazdo = kNieprawidloweGniazdo) {
-  std::lock_guard<std::mutex> blokada(mutex_klientow);
-  for (const auto& [gniazdo, klient] : klienci) {
-    if (gniazdo == wyklucz_gniazdo) {
-      continue;
-    }
-    wyslij_wszystko(gniazdo, wiadomosc);
+  ZegarZnacznikow() {
+    blokady::Wylaczna<std::mutex> blokada(mutex_odswiezania_);
+    Wpis& wpis = wpisy_[0];
+    wpis.przesuniecie_ns = zmierz_przesuniecie();
+    wpis.sekunda = sekunda_dla(std::chrono::steady_clock::now(), wpis.przesuniecie_ns);
+    formatuj(wpis.sekunda, wpis.tekst);
+    aktualny_.store(&wpis, std::memory_order_release);
   }
-}
 
-void wyslij_system(UchwytGniazda gniazdo, const std::string& wiadomosc) {
-  wyslij_wszystko(gniazdo, "[system] " + wiadomosc + "\n");
-}
+  void ustaw_precyzje(PrecyzjaZnacznika precyzja) { precyzja_ = precyzja; }
 
-void wyslij_przypisanie_pokoju(UchwytGniazda gniazdo, const std::string& nazwa_pokoju) {
-  wyslij_wszystko(gniazdo, "ROOM|" + nazwa_pokoju + "\n");
-}
+  int64_t mikrosekundy(Chwila chwila) const {
+    const Wpis* wpis = aktualny_.load(std::memory_order_acquire);
+    return nanosekundy_scienne(chwila, wpis->przesuniecie_ns) / 1000;
+  }
 
-std::string ladunek_listy_pokoi() {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  std::ostringstream ladunek;
-  ladunek << "ROOMS|";
-  bool pierwszy = true;
-  for (const auto& [nazwa, pokoj] : pokoje) {
-    if (!pierwszy) {
-      ladunek << "|";
+  void dopisz(Chwila chwila, std::string* cel) {
+    const Wpis* wpis = aktualny_.load(std::memory_order_acquire);
+    int64_t nanosekundy = nanosekundy_scienne(chwila, wpis->przesuniecie_ns);
+    int64_t sekunda = podziel_w_dol(nanosekundy, kNanosekundWSekundzie);
+    char tekst_starszej[kDlugoscTekstu];
+    const char* tekst = wpis->tekst;
+    if (sekunda > wpis->sekunda) {
+      wpis = odswiez(chwila);
+      nanosekundy = nanosekundy_scienne(chwila, wpis->przesuniecie_ns);
+      sekunda = podziel_w_dol(nanosekundy, kNanosekundWSekundzie);
+      tekst = wpis->tekst;
     }
-    ladunek << nazwa << "|" << (pokoj.haslo.empty() ? "open" : "locked");
-    pierwszy = false;
+    if (sekunda != wpis->sekunda) {
+      formatuj(sekunda, tekst_starszej);
+      tekst = tekst_starszej;
+    }
+    cel->append(tekst, kDlugoscTekstu - 1);
+    int64_t ulamek = nanosekundy - sekunda * kNanosekundWSekundzie;
+    char bufor_ulamka[8];
+    switch (precyzja_) {
+      case PrecyzjaZnacznika::Sekundy:
+        return;
+      case PrecyzjaZnacznika::Milisekundy:
+        std::snprintf(bufor_ulamka, sizeof(bufor_ulamka), ".%03d",
+                      static_cast<int>(ulamek / 1000000));
+        break;
+      case PrecyzjaZnacznika::Mikrosekundy:
+        std::snprintf(bufor_ulamka, sizeof(bufor_ulamka), ".%06d",
+                      static_cast<int>(ulamek / 1000));
+        break;
+    }
+    cel->append(bufor_ulamka);
   }
-  ladunek << "\n";
-  return ladunek.str();
-}
 
-void wyslij_liste_pokoi(UchwytGniazda gniazdo) {
-  wyslij_wszystko(gniazdo, ladunek_listy_pokoi());
-}
+ private:
+  static constexpr size_t kDlugoscTekstu = sizeof("YYYY-mm-dd HH:MM:SS");
+  static constexpr int64_t kNanosekundWSekundzie = 1000000000;
+  static constexpr size_t kLiczbaWpisow = 8;
 
-void rozglos_liste_pokoi() {
-  std::string ladunek = ladunek_listy_pokoi();
-  std::lock_guard<std::mutex> blokada(mutex_klientow);
-  for (const auto& [gniazdo, klient] : klienci) {
-    wyslij_wszystko(gniazdo, ladunek);
-  }
-}
+  struct Wpis {
+    int64_t sekunda = 0;
+    int64_t przesuniecie_ns = 0;
+    char tekst[kDlugoscTekstu] = {};
+  };
 
-std::string przytnij(const std::string& tekst) {
-  size_t start = tekst.find_first_not_of(" \t\r\n");
-  if (start == std::string::npos) {
-    return "";
+  static int64_t podziel_w_dol(int64_t dzielna, int64_t dzielnik) {
+    int64_t iloraz = dzielna / dzielnik;
+    return (dzielna % dzielnik < 0) ? iloraz - 1 : iloraz;
   }
-  size_t koniec = tekst.find_last_not_of(" \t\r\n");
-  return tekst.substr(start, koniec - start + 1);
-}
 
-bool czy_nazwa_bota(const std::string& nazwa) {
-  return nazwa.rfind("Bot", 0) == 0;
-}
+  static int64_t nanosekundy_scienne(Chwila chwila, int64_t przesuniecie_ns) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(chwila.time_since_epoch())
+               .count() +
+           przesuniecie_ns;
+  }
 
-bool utworz_pokoj(const std::string& nazwa_pokoju,
-                  const std::string& haslo,
-                  UchwytGniazda wlasciciel) {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  if (pokoje.find(nazwa_pokoju) != pokoje.end()) {
-    return false;
+  static int64_t sekunda_dla(Chwila chwila, int64_t przesuniecie_ns) {
+    return podziel_w_dol(nanosekundy_scienne(chwila, przesuniecie_ns), kNanosekundWSekundzie);
   }
-  pokoje.emplace(nazwa_pokoju, InformacjePokoju{nazwa_pokoju, haslo, wlasciciel, {}});
-  return true;
-}
 
-bool dolacz_do_pokoju(UchwytGniazda klient,
-                      const std::string& nazwa_pokoju,
-                      const std::string& haslo) {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  auto iter = pokoje.find(nazwa_pokoju);
-  if (iter == pokoje.end()) {
-    return false;
+  static int64_t zmierz_przesuniecie() {
+    auto scienny = std::chrono::system_clock::now();
+    auto monotoniczny = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(scienny.time_since_epoch())
+               .count() -
+           std::chrono::duration_cast<std::chrono::nanoseconds>(
+               monotoniczny.time_since_epoch())
+               .count();
   }
-  if (!iter->second.haslo.empty() && iter->second.haslo != haslo) {
-    return false;
+
+  static void formatuj(int64_t sekunda, char* tekst) {
+    std::time_t czas = static_cast<std::time_t>(sekunda);
+    std::tm rozlozony{};
+#ifdef _WIN32
+    localtime_s(&rozlozony, &czas);
+#else
+    localtime_r(&czas, &rozlozony);
+#endif
+    std::strftime(tekst, kDlugoscTekstu, "%Y-%m-%d %H:%M:%S", &rozlozony);
   }
-  iter->second.czlonkowie.insert(klient);
-  return true;
-}
 
-void opusc_pokoj(UchwytGniazda klient, const std::string& nazwa_pokoju) {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  auto iter = pokoje.find(nazwa_pokoju);
-  if (iter == pokoje.end()) {
-    return;
+  const Wpis* odswiez(Chwila chwila) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_odswiezania_);
+    const Wpis* obecny = aktualny_.load(std::memory_order_relaxed);
+    int64_t przesuniecie_ns = zmierz_przesuniecie();
+    int64_t sekunda = sekunda_dla(chwila, przesuniecie_ns);
+    if (sekunda <= obecny->sekunda) {
+      return obecny;
+    }
+    indeks_ = (indeks_ + 1) % kLiczbaWpisow;
+    Wpis& nowy = wpisy_[indeks_];
+    nowy.sekunda = sekunda;
+    nowy.przesuniecie_ns = przesuniecie_ns;
+    formatuj(sekunda, nowy.tekst);
+    aktualny_.store(&nowy, std::memory_order_release);
+    return &nowy;
   }
-  iter->second.czlonkowie.erase(klient);
-}
 
-enum class WynikUsunieciaPokoju {
-  Sukces,
-  NieZnaleziono,
-  NieWlasciciel,
-  Lobby,
+  Wpis wpisy_[kLiczbaWpisow];
+  size_t indeks_ = 0;
+  std::atomic<const Wpis*> aktualny_{nullptr};
+  blokady::Mutex<std::mutex> mutex_odswiezania_{profil_zegara};
+  PrecyzjaZnacznika precyzja_ = PrecyzjaZnacznika::Sekundy;
 };
 
-WynikUsunieciaPokoju usun_pokoj(const std::string& nazwa_pokoju,
-                               UchwytGniazda proszacy,
-                               std::vector<UchwytGniazda>* czlonkowie) {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  auto iter = pokoje.find(nazwa_pokoju);
-  if (iter == pokoje.end()) {
-    return WynikUsunieciaPokoju::NieZnaleziono;
-  }
-  if (nazwa_pokoju == "Lobby") {
-    return WynikUsunieciaPokoju::Lobby;
+ZegarZnacznikow zegar_znacznikow;
+
+struct UstawieniaLogu {
+  std::chrono::milliseconds co_ile_flush{0};
+  size_t flush_co_rekordow = 0;
+  bool fsync_przy_zamknieciu = false;
+  size_t limit_kolejki = 1 << 20;
+  size_t rotacja_co_bajtow = 0;
+  std::chrono::minutes rotacja_co{0};
+  bool kompresja = false;
+};
+
+class Archiwizator {
+ public:
+  ~Archiwizator() { zatrzymaj(); }
+
+  void uruchom() {
+    if (!watek_.joinable()) {
+      watek_ = std::thread(&Archiwizator::petla, this);
+    }
   }
-  if (iter->second.wlasciciel != proszacy) {
-    return WynikUsunieciaPokoju::NieWlasciciel;
+
+  void dodaj(std::string sciezka) {
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_);
+      kolejka_.push_back(std::move(sciezka));
+    }
+    zmiana_.notify_one();
   }
-  czlonkowie->assign(iter->second.czlonkowie.begin(), iter->second.czlonkowie.end());
-  pokoje.erase(iter);
-  return WynikUsunieciaPokoju::Sukces;
-}
 
-void rozglos_wiadomosc_pokoju(const std::string& nazwa_pokoju,
-                             const std::string& wiadomosc,
-                             UchwytGniazda wyklucz_gniazdo = kNieprawidloweGniazdo) {
-  std::lock_guard<std::mutex> blokada(mutex_pokoi);
-  auto iter = pokoje.find(nazwa_pokoju);
-  if (iter == pokoje.end()) {
-    return;
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_);
+      koniec_ = true;
+    }
+    zmiana_.notify_one();
+    watek_.join();
   }
-  for (UchwytGniazda gniazdo : iter->second.czlonkowie) {
-    if (gniazdo == wyklucz_gniazdo) {
-      continue;
+
+  uint64_t skompresowane() const { return skompresowane_.load(std::memory_order_relaxed); }
+
+ private:
+  void petla() {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    while (true) {
+      zmiana_.wait(blokada, [this] { return koniec_ || !kolejka_.empty(); });
+      if (kolejka_.empty()) {
+        return;
+      }
+      std::string sciezka = std::move(kolejka_.front());
+      kolejka_.pop_front();
+      blokada.unlock();
+      if (kompresja::kompresuj_plik(sciezka, sciezka + ".lzb")) {
+        std::remove(sciezka.c_str());
+        skompresowane_.fetch_add(1, std::memory_order_relaxed);
+      }
+      blokada.lock();
     }
-    wyslij_wszystko(gniazdo, wiadomosc);
   }
-}
 
-void obsluz_prywatna_wiadomosc(UchwytGniazda nadawca,
-                              const std::string& nazwa_nadawcy,
-                              const std::string& komenda) {
-  std::istringstream strumien(komenda);
-  std::string token;
-  strumien >> token;
-  std::string nazwa_odbiorcy;
-  strumien >> nazwa_odbiorcy;
-  std::string wiadomosc;
-  std::getline(strumien, wiadomosc);
-  wiadomosc = przytnij(wiadomosc);
+  blokady::Mutex<std::mutex> mutex_{profil_archiwizatora};
+  std::condition_variable_any zmiana_;
+  std::deque<std::string> kolejka_;
+  bool koniec_ = false;
+  std::atomic<uint64_t> skompresowane_{0};
+  std::thread watek_;
+};
 
-  if (nazwa_odbiorcy.empty() || wiadomosc.empty()) {
-    wyslij_system(nadawca, "Użycie: /msg <użytkownik> <wiadomość>");
-    return;
+struct MetadaneLogu {
+  magazyn::TypRekordu typ = magazyn::TypRekordu::Zdarzenie;
+  uint32_t id_pokoju = 0;
+  uint32_t id_nadawcy = 0;
+  uint32_t id_odbiorcy = 0;
+  int64_t czas_us = 0;
+};
+
+magazyn::Magazyn magazyn_wiadomosci;
+
+class PotokLogu {
+ public:
+  PotokLogu() : glowa_(&zaslepka_), ogon_(&zaslepka_) {}
+
+  ~PotokLogu() { zatrzymaj(); }
+
+  bool otworz(const std::string& sciezka,
+              const UstawieniaLogu& ustawienia,
+              magazyn::Magazyn* magazyn) {
+    sciezka_ = sciezka;
+    ustawienia_ = ustawienia;
+    if (!sciezka_.empty() && !otworz_plik()) {
+      return false;
+    }
+    if (ustawienia_.kompresja) {
+      archiwizator_.uruchom();
+    }
+    magazyn_ = magazyn;
+    pisarz_ = std::thread(&PotokLogu::petla, this);
+    return true;
   }
 
-  UchwytGniazda gniazdo_odbiorcy = kNieprawidloweGniazdo;
-  {
-    std::lock_guard<std::mutex> blokada(mutex_klientow);
-    for (const auto& [gniazdo, klient] : klienci) {
-      if (klient.nazwa == nazwa_odbiorcy) {
-        gniazdo_odbiorcy = gniazdo;
-        break;
-      }
+  void zapisz(std::string tresc, const MetadaneLogu& metadane) {
+    if (!przyjmuje_.load(std::memory_order_relaxed) ||
+        glebokosc_.load(std::memory_order_relaxed) >= ustawienia_.limit_kolejki) {
+      odrzucone_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto* wezel = new Wezel;
+    wezel->czas = std::chrono::steady_clock::now();
+    wezel->tresc = std::move(tresc);
+    wezel->metadane = metadane;
+    glebokosc_.fetch_add(1);
+    wstaw(wezel);
+    if (pisarz_spi_.load()) {
+      blokady::Wylaczna<std::mutex> blokada(mutex_budzenia_);
+      budzenie_.notify_one();
     }
   }
 
-  if (gniazdo_odbiorcy == kNieprawidloweGniazdo) {
-    wyslij_system(nadawca, "Nie znaleziono użytkownika: " + nazwa_odbiorcy);
-    return;
+  void zatrzymaj() {
+    if (!pisarz_.joinable()) {
+      return;
+    }
+    przyjmuje_.store(false);
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_budzenia_);
+      koniec_ = true;
+    }
+    budzenie_.notify_one();
+    pisarz_.join();
+    archiwizator_.zatrzymaj();
+    if (magazyn_ && ustawienia_.fsync_przy_zamknieciu) {
+      magazyn_->zsynchronizuj();
+    }
+    if (!plik_) {
+      return;
+    }
+    std::fflush(plik_);
+    if (ustawienia_.fsync_przy_zamknieciu) {
+#ifdef _WIN32
+      _commit(_fileno(plik_));
+#else
+      fsync(fileno(plik_));
+#endif
+    }
+    std::fclose(plik_);
+    plik_ = nullptr;
   }
 
-  std::string sformatowana = "[private] " + nazwa_nadawcy + ": " + wiadomosc + "\n";
-  wyslij_wszystko(gniazdo_odbiorcy, sformatowana);
-  wyslij_wszystko(nadawca, sformatowana);
-  zapisz_log("[private] " + nazwa_nadawcy + " -> " + nazwa_odbiorcy + ": " + wiadomosc);
-}
+  void popros_o_ponowne_otwarcie() { ponowne_otwarcie_.store(true); }
 
-void obsluz_klienta(UchwytGniazda gniazdo, int id_klienta) {
-  std::string nazwa_klienta = "gość" + std::to_string(id_klienta);
-  {
-    std::lock_guard<std::mutex> blokada(mutex_klientow);
-    klienci[gniazdo] = {gniazdo, nazwa_klienta, "Lobby"};
-  }
-  dolacz_do_pokoju(gniazdo, "Lobby", "");
-  wyslij_przypisanie_pokoju(gniazdo, "Lobby");
-  wyslij_liste_pokoi(gniazdo);
+  size_t glebokosc() const { return glebokosc_.load(std::memory_order_relaxed); }
+  uint64_t rotacje() const { return rotacje_.load(std::memory_order_relaxed); }
+  uint64_t skompresowane() const { return archiwizator_.skompresowane(); }
+  uint64_t odrzucone() const { return odrzucone_.load(std::memory_order_relaxed); }
+  uint64_t zapisane() const { return zapisane_.load(std::memory_order_relaxed); }
 
-  wyslij_system(gniazdo, "Witaj! Ustaw nazwę poleceniem /name <nick>.");
-  wyslij_system(gniazdo, "Użyj /msg <użytkownik> <wiadomość> do prywatnych czatów.");
-  wyslij_system(gniazdo,
-                "Pokoje: /create <pokój> [hasło], /join <pokój> [hasło], /leave, /delete <pokój>.");
+ private:
+  struct Wezel {
+    std::atomic<Wezel*> nastepny{nullptr};
+    ZegarZnacznikow::Chwila czas;
+    std::string tresc;
+    MetadaneLogu metadane;
+  };
 
-  rozglos_liste_pokoi();
+  bool otworz_plik() {
+    plik_ = std::fopen(sciezka_.c_str(), "a");
+    if (!plik_) {
+      return false;
+    }
+    std::fseek(plik_, 0, SEEK_END);
+    long pozycja = std::ftell(plik_);
+    rozmiar_pliku_ = pozycja > 0 ? static_cast<size_t>(pozycja) : 0;
+    otwarto_ = std::chrono::steady_clock::now();
+    return true;
+  }
 
-  zapisz_log(nazwa_klienta + " dołączył do pokoju Lobby.");
+  std::string nazwa_archiwum() const {
+    std::time_t czas = std::time(nullptr);
+    std::tm rozlozony{};
+#ifdef _WIN32
+    localtime_s(&rozlozony, &czas);
+#else
+    localtime_r(&czas, &rozlozony);
+#endif
+    char znacznik[sizeof("YYYYmmdd-HHMMSS")];
+    std::strftime(znacznik, sizeof(znacznik), "%Y%m%d-%H%M%S", &rozlozony);
+    std::string podstawa = sciezka_ + "." + znacznik;
+    std::string nazwa = podstawa;
+    for (int numer = 2; istnieje(nazwa) || istnieje(nazwa + ".lzb"); ++numer) {
+      nazwa = podstawa + "-" + std::to_string(numer);
+    }
+    return nazwa;
+  }
 
-  std::string przychodzace;
-  char bufor[1024];
-  while (uruchomione.load()) {
-    std::memset(bufor, 0, sizeof(bufor));
-    RozmiarGniazda odebrano = recv(gniazdo, bufor, sizeof(bufor) - 1, 0);
-    if (odebrano <= 0) {
-      break;
+  static bool istnieje(const std::string& sciezka) {
+    std::FILE* plik = std::fopen(sciezka.c_str(), "r");
+    if (!plik) {
+      return false;
     }
-    przychodzace.append(bufor, static_cast<size_t>(odebrano));
-    size_t indeks_nowej_linii = przychodzace.find('\n');
-    while (indeks_nowej_linii != std::string::npos) {
-      std::string linia = przytnij(przychodzace.substr(0, indeks_nowej_linii));
-      przychodzace.erase(0, indeks_nowej_linii + 1);
-      indeks_nowej_linii = przychodzace.find('\n');
-      if (linia.empty()) {
-        continue;
-      }
+    std::fclose(plik);
+    return true;
+  }
 
-      if (linia.rfind("/name ", 0) == 0) {
-        std::string nowa_nazwa = przytnij(linia.substr(6));
-        if (nowa_nazwa.empty()) {
-          wyslij_system(gniazdo, "Nazwa nie może być pusta.");
-          continue;
-        }
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          for (const auto& [gniazdo_klienta, klient] : klienci) {
-            if (klient.nazwa == nowa_nazwa) {
-              wyslij_system(gniazdo, "Nazwa jest już zajęta.");
-              nowa_nazwa.clear();
-              break;
-            }
-          }
-          if (!nowa_nazwa.empty()) {
-            klienci[gniazdo].nazwa = nowa_nazwa;
-          }
-        }
-        if (!nowa_nazwa.empty()) {
-          if (!czy_nazwa_bota(nowa_nazwa)) {
-            rozglos_wiadomosc(
-                "[system] " + nazwa_klienta + " ma teraz nazwę " + nowa_nazwa + ".\n");
-          }
-          zapisz_log(nazwa_klienta + " zmienił nazwę na " + nowa_nazwa);
-          nazwa_klienta = nowa_nazwa;
+  void sprawdz_rotacje(std::chrono::steady_clock::time_point teraz) {
+    if (sciezka_.empty()) {
+      return;
+    }
+    bool ponownie = ponowne_otwarcie_.exchange(false) || !plik_;
+    bool rotacja = plik_ && rozmiar_pliku_ > 0 &&
+                   ((ustawienia_.rotacja_co_bajtow > 0 &&
+                     rozmiar_pliku_ >= ustawienia_.rotacja_co_bajtow) ||
+                    (ustawienia_.rotacja_co.count() > 0 && teraz - otwarto_ >= ustawienia_.rotacja_co));
+    if (!ponownie && !rotacja) {
+      return;
+    }
+    if (plik_) {
+      std::fclose(plik_);
+      plik_ = nullptr;
+    }
+    if (rotacja) {
+      std::string archiwum = nazwa_archiwum();
+      if (std::rename(sciezka_.c_str(), archiwum.c_str()) == 0) {
+        rotacje_.fetch_add(1, std::memory_order_relaxed);
+        if (ustawienia_.kompresja) {
+          archiwizator_.dodaj(std::move(archiwum));
         }
-        continue;
       }
+    }
+    otworz_plik();
+  }
 
-      if (linia.rfind("/msg ", 0) == 0) {
-        obsluz_prywatna_wiadomosc(gniazdo, nazwa_klienta, linia);
-        continue;
-      }
+  void zdefiniuj(magazyn::TypRekordu typ, uint32_t identyfikator, const Slownik& slownik) {
+    if (identyfikator != 0 && !magazyn_->zna(typ, identyfikator)) {
+      magazyn_->zdefiniuj(typ, identyfikator, slownik.nazwa(identyfikator));
+    }
+  }
 
-      if (linia == "/rooms") {
-        wyslij_liste_pokoi(gniazdo);
-        continue;
+  void zapisz_w_magazynie(const Wezel& wezel) {
+    const MetadaneLogu& metadane = wezel.metadane;
+    zdefiniuj(magazyn::TypRekordu::DefinicjaPokoju, metadane.id_pokoju, slownik_pokoi);
+    zdefiniuj(magazyn::TypRekordu::DefinicjaUzytkownika, metadane.id_nadawcy,
+              slownik_uzytkownikow);
+    zdefiniuj(magazyn::TypRekordu::DefinicjaUzytkownika, metadane.id_odbiorcy,
+              slownik_uzytkownikow);
+    magazyn::Rekord rekord;
+    rekord.typ = metadane.typ;
+    rekord.czas_us =
+        metadane.czas_us != 0 ? metadane.czas_us : zegar_znacznikow.mikrosekundy(wezel.czas);
+    rekord.id_pokoju = metadane.id_pokoju;
+    rekord.id_nadawcy = metadane.id_nadawcy;
+    rekord.id_odbiorcy = metadane.id_odbiorcy;
+    rekord.tresc = wezel.tresc;
+    if (!magazyn_->dopisz(rekord)) {
+      odrzucone_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void wstaw(Wezel* wezel) {
+    wezel->nastepny.store(nullptr, std::memory_order_relaxed);
+    Wezel* poprzedni = glowa_.exchange(wezel, std::memory_order_acq_rel);
+    poprzedni->nastepny.store(wezel, std::memory_order_release);
+  }
+
+  Wezel* zdejmij() {
+    Wezel* ogon = ogon_;
+    Wezel* nastepny = ogon->nastepny.load(std::memory_order_acquire);
+    if (ogon == &zaslepka_) {
+      if (!nastepny) {
+        return nullptr;
       }
+      ogon_ = nastepny;
+      ogon = nastepny;
+      nastepny = nastepny->nastepny.load(std::memory_order_acquire);
+    }
+    if (nastepny) {
+      ogon_ = nastepny;
+      return ogon;
+    }
+    if (ogon != glowa_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    wstaw(&zaslepka_);
+    nastepny = ogon->nastepny.load(std::memory_order_acquire);
+    if (nastepny) {
+      ogon_ = nastepny;
+      return ogon;
+    }
+    return nullptr;
+  }
 
-      if (linia.rfind("/create ", 0) == 0) {
-        std::istringstream strumien(linia.substr(8));
-        std::string nazwa_pokoju;
-        std::string haslo;
-        strumien >> nazwa_pokoju;
-        strumien >> haslo;
-        if (nazwa_pokoju.empty()) {
-          wyslij_system(gniazdo, "Użycie: /create <pokój> [hasło]");
-          continue;
+  void petla() {
+    std::string paczka;
+    paczka.reserve(kRozmiarPaczki);
+    auto ostatni_flush = std::chrono::steady_clock::now();
+    size_t rekordy_od_flush = 0;
+    while (true) {
+      paczka.clear();
+      size_t rekordy = 0;
+      while (paczka.size() < kRozmiarPaczki && rekordy < kRekordyPaczki) {
+        Wezel* wezel = zdejmij();
+        if (!wezel) {
+          break;
         }
-        if (!utworz_pokoj(nazwa_pokoju, haslo, gniazdo)) {
-          wyslij_system(gniazdo, "Pokój już istnieje.");
-          continue;
-        }
-        rozglos_liste_pokoi();
-        std::string obecny_pokoj;
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          obecny_pokoj = klienci[gniazdo].pokoj;
+        if (!sciezka_.empty()) {
+          paczka += '[';
+          zegar_znacznikow.dopisz(wezel->czas, &paczka);
+          paczka += "] ";
+          paczka += wezel->tresc;
+          paczka += '\n';
         }
-        if (!dolacz_do_pokoju(gniazdo, nazwa_pokoju, haslo)) {
-          wyslij_system(gniazdo, "Pokój utworzony, ale nie udało się dołączyć.");
-          continue;
+        if (magazyn_) {
+          zapisz_w_magazynie(*wezel);
         }
-        if (!obecny_pokoj.empty() && obecny_pokoj != nazwa_pokoju) {
-          opusc_pokoj(gniazdo, obecny_pokoj);
-          if (!czy_nazwa_bota(nazwa_klienta)) {
-            rozglos_wiadomosc_pokoju(
-                obecny_pokoj, "[system] " + nazwa_klienta + " opuścił pokój.\n", gniazdo);
-          }
+        ++rekordy;
+        delete wezel;
+      }
+      if (rekordy > 0) {
+        if (plik_) {
+          std::fwrite(paczka.data(), 1, paczka.size(), plik_);
+          rozmiar_pliku_ += paczka.size();
+        } else if (!sciezka_.empty()) {
+          odrzucone_.fetch_add(rekordy, std::memory_order_relaxed);
         }
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          klienci[gniazdo].pokoj = nazwa_pokoju;
+        glebokosc_.fetch_sub(rekordy, std::memory_order_relaxed);
+        zapisane_.fetch_add(rekordy, std::memory_order_relaxed);
+        rekordy_od_flush += rekordy;
+      }
+      auto teraz = std::chrono::steady_clock::now();
+      bool pora_flush = ustawienia_.co_ile_flush.count() == 0
+                            ? ustawienia_.flush_co_rekordow == 0 && rekordy > 0
+                            : teraz - ostatni_flush >= ustawienia_.co_ile_flush;
+      if (ustawienia_.flush_co_rekordow > 0 &&
+          rekordy_od_flush >= ustawienia_.flush_co_rekordow) {
+        pora_flush = true;
+      }
+      if (pora_flush && rekordy_od_flush > 0) {
+        if (plik_) {
+          std::fflush(plik_);
         }
-        wyslij_przypisanie_pokoju(gniazdo, nazwa_pokoju);
-        if (!czy_nazwa_bota(nazwa_klienta)) {
-          rozglos_wiadomosc_pokoju(
-              nazwa_pokoju, "[system] " + nazwa_klienta + " dołączył do pokoju.\n", gniazdo);
+        ostatni_flush = teraz;
+        rekordy_od_flush = 0;
+      }
+      sprawdz_rotacje(teraz);
+      if (rekordy > 0) {
+        continue;
+      }
+      blokady::Wylaczna<std::mutex> blokada(mutex_budzenia_);
+      if (koniec_) {
+        if (glebokosc_.load(std::memory_order_relaxed) == 0) {
+          return;
         }
-        zapisz_log(nazwa_klienta + " dołączył do pokoju " + nazwa_pokoju);
-        wyslij_system(gniazdo, "Pokój utworzony i dołączono: " + nazwa_pokoju);
         continue;
       }
+      pisarz_spi_.store(true);
+      if (glebokosc_.load() == 0) {
+        budzenie_.wait_for(blokada, kMaksymalnyCzasSnu);
+      }
+      pisarz_spi_.store(false, std::memory_order_relaxed);
+    }
+  }
 
-      if (linia.rfind("/join ", 0) == 0) {
-        std::istringstream strumien(linia.substr(6));
-        std::string nazwa_pokoju;
-        std::string haslo;
-        strumien >> nazwa_pokoju;
-        strumien >> haslo;
-        if (nazwa_pokoju.empty()) {
-          wyslij_system(gniazdo, "Użycie: /join <pokój> [hasło]");
-          continue;
-        }
-        std::string obecny_pokoj;
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          obecny_pokoj = klienci[gniazdo].pokoj;
-        }
-        if (!dolacz_do_pokoju(gniazdo, nazwa_pokoju, haslo)) {
-          wyslij_system(gniazdo, "Nie można dołączyć do pokoju. Sprawdź nazwę lub hasło.");
-          continue;
-        }
-        if (!obecny_pokoj.empty() && obecny_pokoj != nazwa_pokoju) {
-          opusc_pokoj(gniazdo, obecny_pokoj);
-          if (!czy_nazwa_bota(nazwa_klienta)) {
-            rozglos_wiadomosc_pokoju(
-                obecny_pokoj, "[system] " + nazwa_klienta + " opuścił pokój.\n", gniazdo);
-          }
+  static constexpr size_t kRozmiarPaczki = 256 * 1024;
+  static constexpr size_t kRekordyPaczki = 4096;
+  static constexpr std::chrono::milliseconds kMaksymalnyCzasSnu{50};
+
+  std::atomic<Wezel*> glowa_;
+  Wezel* ogon_;
+  Wezel zaslepka_;
+  std::atomic<size_t> glebokosc_{0};
+  std::atomic<uint64_t> odrzucone_{0};
+  std::atomic<uint64_t> zapisane_{0};
+  std::atomic<bool> przyjmuje_{true};
+  std::atomic<bool> pisarz_spi_{false};
+  std::atomic<bool> ponowne_otwarcie_{false};
+  std::atomic<uint64_t> rotacje_{0};
+  blokady::Mutex<std::mutex> mutex_budzenia_{profil_budzenia_logu};
+  std::condition_variable_any budzenie_;
+  bool koniec_ = false;
+  UstawieniaLogu ustawienia_;
+  std::string sciezka_;
+  std::FILE* plik_ = nullptr;
+  size_t rozmiar_pliku_ = 0;
+  std::chrono::steady_clock::time_point otwarto_;
+  Archiwizator archiwizator_;
+  magazyn::Magazyn* magazyn_ = nullptr;
+  std::thread pisarz_;
+};
+
+PotokLogu potok_logu;
+
+void zapisz_log(std::string wiadomosc, const MetadaneLogu& metadane = {}) {
+  potok_logu.zapisz(std::move(wiadomosc), metadane);
+}
+
+#ifdef MSG_NOSIGNAL
+constexpr int kFlagiWysylania = MSG_NOSIGNAL;
+#else
+constexpr int kFlagiWysylania = 0;
+#endif
+
+constexpr size_t kMaksWektorowWysylki = 64;
+
+RozmiarGniazda wyslij_wektorowo(UchwytGniazda gniazdo,
+                                const std::deque<WspolnyBufor>& bufory,
+                                size_t przesuniecie) {
+  metryki_serwera.wywolania_wysylki.dodaj();
+#ifdef _WIN32
+  const std::string& pierwszy = *bufory.front();
+  return send(gniazdo, pierwszy.data() + przesuniecie,
+              static_cast<int>(pierwszy.size() - przesuniecie), 0);
+#else
+  iovec wektory[kMaksWektorowWysylki];
+  size_t liczba = 0;
+  for (const WspolnyBufor& bufor : bufory) {
+    if (liczba == kMaksWektorowWysylki) {
+      break;
+    }
+    size_t poczatek = liczba == 0 ? przesuniecie : 0;
+    wektory[liczba].iov_base = const_cast<char*>(bufor->data() + poczatek);
+    wektory[liczba].iov_len = bufor->size() - poczatek;
+    ++liczba;
+  }
+  msghdr naglowek{};
+  naglowek.msg_iov = wektory;
+  naglowek.msg_iovlen = liczba;
+  return sendmsg(gniazdo, &naglowek, kFlagiWysylania);
+#endif
+}
+
+void ustaw_opcje_tcp(UchwytGniazda gniazdo, int opcja, bool wlaczona) {
+  int wartosc = wlaczona ? 1 : 0;
+  setsockopt(gniazdo, IPPROTO_TCP, opcja, reinterpret_cast<const char*>(&wartosc),
+             static_cast<int>(sizeof(wartosc)));
+}
+
+bool zakorkuj(UchwytGniazda gniazdo, size_t liczba_buforow) {
+#ifdef TCP_CORK
+  if (ustawienia_scalania.cork && liczba_buforow > kMaksWektorowWysylki) {
+    metryki_serwera.wywolania_wysylki.dodaj();
+    ustaw_opcje_tcp(gniazdo, TCP_CORK, true);
+    return true;
+  }
+#else
+  (void)gniazdo;
+  (void)liczba_buforow;
+#endif
+  return false;
+}
+
+void odkorkuj(UchwytGniazda gniazdo) {
+#ifdef TCP_CORK
+  metryki_serwera.wywolania_wysylki.dodaj();
+  ustaw_opcje_tcp(gniazdo, TCP_CORK, false);
+#else
+  (void)gniazdo;
+#endif
+}
+
+size_t zdejmij_wyslane(std::deque<WspolnyBufor>& bufory, size_t* przesuniecie, size_t wyslano) {
+  size_t zwolnione = 0;
+  while (wyslano > 0) {
+    size_t pozostalo = bufory.front()->size() - *przesuniecie;
+    if (wyslano < pozostalo) {
+      *przesuniecie += wyslano;
+      break;
+    }
+    wyslano -= pozostalo;
+    zwolnione += bufory.front()->size();
+    bufory.pop_front();
+    *przesuniecie = 0;
+  }
+  return zwolnione;
+}
+
+void odetnij_polaczenie(Polaczenie& polaczenie) {
+  polaczenie.zamkniete = true;
+  polaczenie.kolejka.clear();
+  polaczenie.bajty_w_kolejce = 0;
+  polaczenie.wyslano_z_pierwszej = 0;
+#ifdef _WIN32
+  shutdown(polaczenie.sesja.gniazdo, SD_BOTH);
+#else
+  shutdown(polaczenie.sesja.gniazdo, SHUT_RDWR);
+#endif
+  polaczenie.zmiana_kolejki.notify_all();
+}
+
+void petla_pisarza(Polaczenie* polaczenie) {
+  std::deque<WspolnyBufor> paczka;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> blokada(polaczenie->mutex_wyjscia);
+      if (polaczenie->wysylanie) {
+        polaczenie->wysylanie = false;
+        polaczenie->zmiana_kolejki.notify_all();
+      }
+      polaczenie->zmiana_kolejki.wait(
+          blokada, [&] { return polaczenie->zamkniete || !polaczenie->kolejka.empty(); });
+      if (ustawienia_scalania.okno.count() > 0) {
+        polaczenie->zmiana_kolejki.wait_for(blokada, ustawienia_scalania.okno, [&] {
+          return polaczenie->zamkniete || polaczenie->przepelniona ||
+                 polaczenie->bajty_w_kolejce >= ustawienia_scalania.prog_bajtow;
+        });
+      }
+      if (polaczenie->zamkniete) {
+        return;
+      }
+      paczka.swap(polaczenie->kolejka);
+      polaczenie->przepelniona = false;
+      polaczenie->wysylanie = true;
+    }
+    polaczenie->zmiana_kolejki.notify_all();
+    bool zakorkowane = zakorkuj(polaczenie->sesja.gniazdo, paczka.size());
+    size_t przesuniecie = 0;
+    while (!paczka.empty()) {
+      RozmiarGniazda wyslano = wyslij_wektorowo(polaczenie->sesja.gniazdo, paczka, przesuniecie);
+      if (wyslano <= 0) {
+        std::lock_guard<std::mutex> blokada(polaczenie->mutex_wyjscia);
+        odetnij_polaczenie(*polaczenie);
+        return;
+      }
+      metryki_serwera.bajty_wychodzace.dodaj(static_cast<uint64_t>(wyslano));
+      size_t zwolnione = zdejmij_wyslane(paczka, &przesuniecie, static_cast<size_t>(wyslano));
+      if (zwolnione == 0) {
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> blokada(polaczenie->mutex_wyjscia);
+        if (polaczenie->zamkniete) {
+          return;
         }
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          klienci[gniazdo].pokoj = nazwa_pokoju;
+        polaczenie->bajty_w_kolejce -= zwolnione;
+      }
+      polaczenie->zmiana_kolejki.notify_all();
+    }
+    if (zakorkowane) {
+      odkorkuj(polaczenie->sesja.gniazdo);
+    }
+  }
+}
+
+#ifdef __linux__
+bool wypchnij_kolejke(Polaczenie& polaczenie) {
+  while (!polaczenie.kolejka.empty()) {
+    ssize_t wyslano = wyslij_wektorowo(polaczenie.sesja.gniazdo, polaczenie.kolejka,
+                                       polaczenie.wyslano_z_pierwszej);
+    if (wyslano > 0) {
+      metryki_serwera.bajty_wychodzace.dodaj(static_cast<uint64_t>(wyslano));
+      polaczenie.bajty_w_kolejce -= zdejmij_wyslane(
+          polaczenie.kolejka, &polaczenie.wyslano_z_pierwszej, static_cast<size_t>(wyslano));
+      continue;
+    }
+    if (wyslano < 0 && errno == EINTR) {
+      continue;
+    }
+    if (wyslano < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+    return false;
+  }
+  polaczenie.przepelniona = false;
+  polaczenie.zmiana_kolejki.notify_all();
+  return true;
+}
+
+bool oproznij_wychodzace(Polaczenie& polaczenie) {
+  bool zakorkowane = zakorkuj(polaczenie.sesja.gniazdo, polaczenie.kolejka.size());
+  bool wynik = wypchnij_kolejke(polaczenie);
+  if (zakorkowane) {
+    odkorkuj(polaczenie.sesja.gniazdo);
+  }
+  return wynik;
+}
+
+// Połączenia czekające na opróżnienie przez reaktor, który je obsługuje. Wątek
+// kolejkujący tylko dopisuje połączenie i budzi reaktor, więc wiadomość do pokoju
+// nie kosztuje go wywołań systemowych na gniazdach wszystkich odbiorców.
+struct GotoweDoWysylki {
+  blokady::Mutex<std::mutex> mutex{profil_wysylki_reaktora};
+  std::vector<std::shared_ptr<Polaczenie>> polaczenia;
+  int budzik = -1;
+  std::thread::id watek;
+};
+
+// Wywoływane pod mutex_wyjscia połączenia.
+void zaplanuj_wysylke(Polaczenie& polaczenie) {
+  if (polaczenie.zaplanowane) {
+    return;
+  }
+  polaczenie.zaplanowane = true;
+  GotoweDoWysylki& gotowe = *polaczenie.gotowe;
+  bool obudz;
+  {
+    blokady::Wylaczna<std::mutex> blokada(gotowe.mutex);
+    obudz = gotowe.polaczenia.empty() && std::this_thread::get_id() != gotowe.watek;
+    gotowe.polaczenia.push_back(polaczenie.shared_from_this());
+  }
+  if (obudz) {
+    uint64_t jeden = 1;
+    (void)!write(gotowe.budzik, &jeden, sizeof(jeden));
+  }
+}
+
+class Scalacz {
+ public:
+  ~Scalacz() { zatrzymaj(); }
+
+  void uruchom() { watek_ = std::thread(&Scalacz::petla, this); }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_);
+      koniec_ = true;
+    }
+    zmiana_.notify_one();
+    watek_.join();
+  }
+
+  void zaplanuj(Polaczenie& polaczenie) {
+    auto termin = std::chrono::steady_clock::now() + ustawienia_scalania.okno;
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    oczekujace_.push_back({termin, polaczenie.weak_from_this()});
+    if (oczekujace_.size() == 1) {
+      zmiana_.notify_one();
+    }
+  }
+
+ private:
+  struct Wpis {
+    std::chrono::steady_clock::time_point termin;
+    std::weak_ptr<Polaczenie> polaczenie;
+  };
+
+  void petla() {
+    std::vector<std::shared_ptr<Polaczenie>> gotowe;
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    while (!koniec_) {
+      if (oczekujace_.empty()) {
+        zmiana_.wait(blokada, [this] { return koniec_ || !oczekujace_.empty(); });
+        continue;
+      }
+      auto teraz = std::chrono::steady_clock::now();
+      if (oczekujace_.front().termin > teraz) {
+        zmiana_.wait_until(blokada, oczekujace_.front().termin, [this] { return koniec_; });
+        continue;
+      }
+      while (!oczekujace_.empty() && oczekujace_.front().termin <= teraz) {
+        if (std::shared_ptr<Polaczenie> polaczenie = oczekujace_.front().polaczenie.lock()) {
+          gotowe.push_back(std::move(polaczenie));
         }
-        wyslij_przypisanie_pokoju(gniazdo, nazwa_pokoju);
-        if (!czy_nazwa_bota(nazwa_klienta)) {
-          rozglos_wiadomosc_pokoju(
-              nazwa_pokoju, "[system] " + nazwa_klienta + " dołączył do pokoju.\n", gniazdo);
+        oczekujace_.pop_front();
+      }
+      blokada.unlock();
+      for (const std::shared_ptr<Polaczenie>& polaczenie : gotowe) {
+        std::lock_guard<std::mutex> wyjscie(polaczenie->mutex_wyjscia);
+        if (!polaczenie->zamkniete) {
+          zaplanuj_wysylke(*polaczenie);
         }
-        zapisz_log(nazwa_klienta + " dołączył do pokoju " + nazwa_pokoju);
-        continue;
       }
+      gotowe.clear();
+      blokada.lock();
+    }
+  }
 
-      if (linia.rfind("/delete ", 0) == 0) {
-        std::istringstream strumien(linia.substr(8));
-        std::string nazwa_pokoju;
-        strumien >> nazwa_pokoju;
-        if (nazwa_pokoju.empty()) {
-          wyslij_system(gniazdo, "Użycie: /delete <pokój>");
-          continue;
-        }
-        std::vector<UchwytGniazda> czlonkowie;
-        WynikUsunieciaPokoju wynik = usun_pokoj(nazwa_pokoju, gniazdo, &czlonkowie);
-        if (wynik == WynikUsunieciaPokoju::NieZnaleziono) {
-          wyslij_system(gniazdo, "Nie znaleziono pokoju.");
-          continue;
+  blokady::Mutex<std::mutex> mutex_{profil_scalacza};
+  std::condition_variable_any zmiana_;
+  std::deque<Wpis> oczekujace_;
+  bool koniec_ = false;
+  std::thread watek_;
+};
+
+Scalacz scalacz;
+#endif
+
+void usun_najstarsze(Polaczenie& polaczenie, size_t potrzebne) {
+  auto iter = polaczenie.kolejka.begin();
+  if (polaczenie.wyslano_z_pierwszej > 0) {
+    ++iter;
+  }
+  while (iter != polaczenie.kolejka.end() &&
+         (polaczenie.binarny ||
+          polaczenie.bajty_w_kolejce + potrzebne > ustawienia_kolejek.limit_bajtow)) {
+    polaczenie.bajty_w_kolejce -= (*iter)->size();
+    iter = polaczenie.kolejka.erase(iter);
+    liczniki_kolejek.odrzucone_wiadomosci.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool czekaj_na_miejsce(Polaczenie& polaczenie,
+                       std::unique_lock<std::mutex>& blokada,
+                       size_t potrzebne) {
+  liczniki_kolejek.oczekiwania.fetch_add(1, std::memory_order_relaxed);
+  auto termin = std::chrono::steady_clock::now() + ustawienia_kolejek.limit_oczekiwania;
+  auto jest_miejsce = [&] {
+    return polaczenie.zamkniete || polaczenie.kolejka.empty() ||
+           polaczenie.bajty_w_kolejce + potrzebne <= ustawienia_kolejek.limit_bajtow;
+  };
+  polaczenie.zmiana_kolejki.notify_all();
+  return polaczenie.zmiana_kolejki.wait_until(blokada, termin, jest_miejsce) &&
+         !polaczenie.zamkniete;
+}
+
+void dopisz_definicje(std::string* cel,
+                      protokol::TypRamki typ,
+                      uint32_t identyfikator,
+                      const Slownik& slownik,
+                      std::unordered_set<uint32_t>* znane) {
+  if (identyfikator != 0 && znane->insert(identyfikator).second) {
+    protokol::dopisz_ramke(cel, typ, {identyfikator}, slownik.nazwa(identyfikator));
+  }
+}
+
+WspolnyBufor kodowanie_dla(Polaczenie& polaczenie, const Wiadomosc& wiadomosc) {
+  if (!polaczenie.binarny) {
+    return wiadomosc.tekst;
+  }
+  if (!wiadomosc.ramki) {
+    std::string ramki;
+    protokol::dopisz_ramki_tekstowe(&ramki, *wiadomosc.tekst);
+    return zbuduj_bufor(std::move(ramki));
+  }
+  std::string definicje;
+  dopisz_definicje(&definicje, protokol::TypRamki::DefinicjaPokoju, wiadomosc.id_pokoju,
+                   slownik_pokoi, &polaczenie.znane_pokoje);
+  dopisz_definicje(&definicje, protokol::TypRamki::DefinicjaUzytkownika, wiadomosc.id_nadawcy,
+                   slownik_uzytkownikow, &polaczenie.znani_uzytkownicy);
+  dopisz_definicje(&definicje, protokol::TypRamki::DefinicjaUzytkownika, wiadomosc.id_odbiorcy,
+                   slownik_uzytkownikow, &polaczenie.znani_uzytkownicy);
+  if (definicje.empty()) {
+    return wiadomosc.ramki;
+  }
+  definicje += *wiadomosc.ramki;
+  return zbuduj_bufor(std::move(definicje));
+}
+
+bool kolejkuj_pod_blokada(Polaczenie& polaczenie,
+                          std::unique_lock<std::mutex>& blokada,
+                          const Wiadomosc& wiadomosc) {
+  if (polaczenie.zamkniete) {
+    return false;
+  }
+  WspolnyBufor bufor = kodowanie_dla(polaczenie, wiadomosc);
+  size_t rozmiar = bufor->size();
+  if (rozmiar == 0) {
+    return true;
+  }
+#ifdef __linux__
+  // Reaktor wysyła dopiero na końcu obrotu, więc pełna kolejka nie musi jeszcze
+  // oznaczać wolnego odbiorcy: najpierw spróbuj ją wypchnąć.
+  if (tryb_reaktora && !polaczenie.kolejka.empty() &&
+      polaczenie.bajty_w_kolejce + rozmiar > ustawienia_kolejek.limit_bajtow &&
+      !oproznij_wychodzace(polaczenie)) {
+    odetnij_polaczenie(polaczenie);
+    return false;
+  }
+#endif
+  if (!polaczenie.kolejka.empty() &&
+      polaczenie.bajty_w_kolejce + rozmiar > ustawienia_kolejek.limit_bajtow) {
+    if (!polaczenie.przepelniona) {
+      polaczenie.przepelniona = true;
+      liczniki_kolejek.przepelnienia.fetch_add(1, std::memory_order_relaxed);
+    }
+    switch (ustawienia_kolejek.polityka) {
+      case PolitykaWolnegoOdbiorcy::UsunNajstarsze:
+        usun_najstarsze(polaczenie, rozmiar);
+        if (polaczenie.binarny) {
+          polaczenie.znani_uzytkownicy.clear();
+          polaczenie.znane_pokoje.clear();
+          bufor = kodowanie_dla(polaczenie, wiadomosc);
+          rozmiar = bufor->size();
         }
-        if (wynik == WynikUsunieciaPokoju::Lobby) {
-          wyslij_system(gniazdo, "Lobby nie może zostać usunięte.");
-          continue;
+        break;
+      case PolitykaWolnegoOdbiorcy::Rozlacz:
+        liczniki_kolejek.rozlaczenia.fetch_add(1, std::memory_order_relaxed);
+        odetnij_polaczenie(polaczenie);
+        return false;
+      case PolitykaWolnegoOdbiorcy::Przeciwcisnienie:
+        if (!czekaj_na_miejsce(polaczenie, blokada, rozmiar)) {
+          if (!polaczenie.zamkniete) {
+            liczniki_kolejek.rozlaczenia.fetch_add(1, std::memory_order_relaxed);
+            odetnij_polaczenie(polaczenie);
+          }
+          return false;
         }
-        if (wynik == WynikUsunieciaPokoju::NieWlasciciel) {
-          wyslij_system(gniazdo, "Tylko właściciel pokoju może go usunąć.");
-          continue;
+        break;
+    }
+  }
+  bool kolejka_byla_pusta = polaczenie.kolejka.empty();
+  polaczenie.kolejka.push_back(bufor);
+  polaczenie.bajty_w_kolejce += rozmiar;
+  metryki_serwera.wiadomosci_wychodzace.dodaj();
+  bool scalanie = ustawienia_scalania.okno.count() > 0;
+  bool przekroczono_prog = polaczenie.bajty_w_kolejce >= ustawienia_scalania.prog_bajtow &&
+                           polaczenie.bajty_w_kolejce - rozmiar < ustawienia_scalania.prog_bajtow;
+#ifdef __linux__
+  if (tryb_reaktora) {
+    if (scalanie && kolejka_byla_pusta && !przekroczono_prog) {
+      scalacz.zaplanuj(polaczenie);
+      return true;
+    }
+    if (scalanie ? przekroczono_prog : kolejka_byla_pusta) {
+      zaplanuj_wysylke(polaczenie);
+    }
+    return true;
+  }
+#endif
+  if (kolejka_byla_pusta || (scalanie && przekroczono_prog)) {
+    polaczenie.zmiana_kolejki.notify_all();
+  }
+  return true;
+}
+
+bool kolejkuj_wysylke(Polaczenie& polaczenie, const Wiadomosc& wiadomosc) {
+  std::unique_lock<std::mutex> blokada(polaczenie.mutex_wyjscia);
+  return kolejkuj_pod_blokada(polaczenie, blokada, wiadomosc);
+}
+
+void przelacz_na_binarny(Polaczenie& polaczenie) {
+  std::unique_lock<std::mutex> blokada(polaczenie.mutex_wyjscia);
+  if (polaczenie.binarny) {
+    return;
+  }
+  std::string potwierdzenie = "PROTO|" + std::string(protokol::kNazwaBinarnego) + "\n";
+  kolejkuj_pod_blokada(polaczenie, blokada, Wiadomosc{zbuduj_bufor(std::move(potwierdzenie))});
+  polaczenie.binarny = true;
+  liczba_binarnych.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<Polaczenie> znajdz_polaczenie(UchwytGniazda gniazdo) {
+  return polaczenia.czytaj(gniazdo, [](const std::shared_ptr<Polaczenie>* polaczenie) {
+    return polaczenie ? *polaczenie : nullptr;
+  });
+}
+
+bool wyslij_bufor(UchwytGniazda gniazdo, const Wiadomosc& wiadomosc) {
+  std::shared_ptr<Polaczenie> polaczenie = znajdz_polaczenie(gniazdo);
+  return polaczenie && kolejkuj_wysylke(*polaczenie, wiadomosc);
+}
+
+bool wyslij_wszystko(UchwytGniazda gniazdo, std::string wiadomosc) {
+  return wyslij_bufor(gniazdo, wiadomosc_tekstowa(std::move(wiadomosc)));
+}
+
+void wyslij_do_wielu(const std::vector<UchwytGniazda>& gniazda,
+                     const Wiadomosc& wiadomosc,
+                     UchwytGniazda wyklucz_gniazdo = kNieprawidloweGniazdo) {
+  for (UchwytGniazda gniazdo : gniazda) {
+    if (gniazdo == wyklucz_gniazdo) {
+      continue;
+    }
+    if (std::shared_ptr<Polaczenie> polaczenie = znajdz_polaczenie(gniazdo)) {
+      kolejkuj_wysylke(*polaczenie, wiadomosc);
+    }
+  }
+}
+
+void rozglos_wiadomosc(std::string wiadomosc,
+                       UchwytGniazda wyklucz_gniazdo = kNieprawidloweGniazdo) {
+  Wiadomosc tresc = wiadomosc_tekstowa(std::move(wiadomosc));
+  std::vector<std::shared_ptr<Polaczenie>> odbiorcy;
+  polaczenia.dla_kazdego(
+      [&](UchwytGniazda gniazdo, const std::shared_ptr<Polaczenie>& polaczenie) {
+        if (gniazdo != wyklucz_gniazdo) {
+          odbiorcy.push_back(polaczenie);
         }
-        for (UchwytGniazda gniazdo_czlonka : czlonkowie) {
-          {
-            std::lock_guard<std::mutex> blokada(mutex_klientow);
-            auto iter = klienci.find(gniazdo_czlonka);
-            if (iter != klienci.end()) {
-              iter->second.pokoj = "Lobby";
-            }
-          }
-          dolacz_do_pokoju(gniazdo_czlonka, "Lobby", "");
-          wyslij_przypisanie_pokoju(gniazdo_czlonka, "Lobby");
-          wyslij_system(gniazdo_czlonka, "Pokój usunięty. Przeniesiono Cię do Lobby.");
+      });
+  for (const auto& polaczenie : odbiorcy) {
+    kolejkuj_wysylke(*polaczenie, tresc);
+  }
+}
+
+void wyslij_system(UchwytGniazda gniazdo, const std::string& wiadomosc) {
+  wyslij_wszystko(gniazdo, "[system] " + wiadomosc + "\n");
+}
+
+void wyslij_przypisanie_pokoju(UchwytGniazda gniazdo, const std::string& nazwa_pokoju) {
+  wyslij_wszystko(gniazdo, "ROOM|" + nazwa_pokoju + "\n");
+}
+
+class KatalogPokoi {
+ public:
+  KatalogPokoi() { zbuduj_migawke(0); }
+  ~KatalogPokoi() { zatrzymaj(); }
+
+  void uruchom(std::chrono::milliseconds okno) {
+    okno_ = okno;
+    if (okno_.count() > 0) {
+      watek_ = std::thread(&KatalogPokoi::petla, this);
+    }
+  }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_);
+      koniec_ = true;
+    }
+    zmiana_.notify_one();
+    watek_.join();
+  }
+
+  void dodaj_staly(const std::string& nazwa) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    pokoje_[nazwa] = false;
+    zbuduj_migawke(wersja_.load(std::memory_order_relaxed));
+  }
+
+  void dodano(const std::string& nazwa, bool zablokowany) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    pokoje_[nazwa] = zablokowany;
+    opublikuj("ROOM_ADDED", nazwa + "|" + (zablokowany ? "locked" : "open"));
+  }
+
+  void usunieto(const std::string& nazwa) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    pokoje_.erase(nazwa);
+    opublikuj("ROOM_REMOVED", nazwa);
+  }
+
+  void rozeslij() {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    if (okno_.count() > 0 || rozsylanie_) {
+      return;
+    }
+    rozsylanie_ = true;
+    while (!oczekujace_.empty()) {
+      std::string paczka = std::move(oczekujace_);
+      oczekujace_.clear();
+      blokada.unlock();
+      rozglos_wiadomosc(std::move(paczka));
+      blokada.lock();
+    }
+    rozsylanie_ = false;
+  }
+
+  void wyslij_stan(UchwytGniazda gniazdo, std::optional<uint64_t> wersja_klienta) {
+    uint64_t aktualna = wersja_.load(std::memory_order_acquire);
+    if (wersja_klienta && *wersja_klienta == aktualna) {
+      wyslij_wszystko(gniazdo, "ROOM_VERSION|" + std::to_string(aktualna) + "\n");
+      return;
+    }
+    std::string zmiany;
+    if (wersja_klienta && *wersja_klienta < aktualna &&
+        dopisz_zmiany_od(*wersja_klienta, &zmiany)) {
+      wyslij_wszystko(gniazdo, std::move(zmiany));
+      return;
+    }
+    uint64_t wersja_migawki = 0;
+    wyslij_bufor(gniazdo, aktualna_migawka(&wersja_migawki));
+    if (wersja_.load(std::memory_order_acquire) != wersja_migawki &&
+        dopisz_zmiany_od(wersja_migawki, &zmiany)) {
+      wyslij_wszystko(gniazdo, std::move(zmiany));
+    }
+  }
+
+ private:
+  struct Migawka {
+    std::atomic<uint32_t> czytelnicy{0};
+    uint64_t wersja = 0;
+    Wiadomosc ladunek;
+  };
+
+  Wiadomosc aktualna_migawka(uint64_t* wersja) {
+    while (true) {
+      Migawka* migawka = migawka_.load();
+      migawka->czytelnicy.fetch_add(1);
+      if (migawka_.load() == migawka) {
+        Wiadomosc ladunek = migawka->ladunek;
+        *wersja = migawka->wersja;
+        migawka->czytelnicy.fetch_sub(1);
+        return ladunek;
+      }
+      migawka->czytelnicy.fetch_sub(1);
+    }
+  }
+
+  void zbuduj_migawke(uint64_t wersja) {
+    std::string ladunek = "ROOMS|";
+    bool pierwszy = true;
+    for (const auto& [nazwa, zablokowany] : pokoje_) {
+      if (!pierwszy) {
+        ladunek += '|';
+      }
+      ladunek += nazwa + "|" + (zablokowany ? "locked" : "open");
+      pierwszy = false;
+    }
+    ladunek += "\nROOM_VERSION|" + std::to_string(wersja) + "\n";
+    Migawka* obecna = migawka_.load(std::memory_order_relaxed);
+    Migawka* wolna = nullptr;
+    while (!wolna) {
+      for (Migawka& kandydatka : migawki_) {
+        if (&kandydatka != obecna && kandydatka.czytelnicy.load() == 0) {
+          wolna = &kandydatka;
+          break;
         }
-        rozglos_liste_pokoi();
-        zapisz_log(nazwa_klienta + " usunął pokój " + nazwa_pokoju);
-        continue;
       }
+      if (!wolna) {
+        std::this_thread::yield();
+      }
+    }
+    wolna->wersja = wersja;
+    wolna->ladunek = wiadomosc_tekstowa(std::move(ladunek));
+    migawka_.store(wolna);
+  }
+
+  bool dopisz_zmiany_od(uint64_t wersja_klienta, std::string* ladunek) {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    uint64_t aktualna = wersja_.load(std::memory_order_relaxed);
+    if (wersja_klienta >= aktualna || historia_.front().first > wersja_klienta + 1) {
+      return false;
+    }
+    for (const auto& [wersja, linia] : historia_) {
+      if (wersja > wersja_klienta) {
+        *ladunek += linia;
+      }
+    }
+    *ladunek += "ROOM_VERSION|" + std::to_string(aktualna) + "\n";
+    return true;
+  }
+
+  void opublikuj(const char* rodzaj, const std::string& tresc) {
+    uint64_t wersja = wersja_.load(std::memory_order_relaxed) + 1;
+    std::string linia = std::string(rodzaj) + "|" + std::to_string(wersja) + "|" + tresc + "\n";
+    historia_.emplace_back(wersja, linia);
+    wersja_.store(wersja, std::memory_order_release);
+    if (historia_.size() > kDlugoscHistorii) {
+      historia_.pop_front();
+    }
+    zbuduj_migawke(wersja);
+    oczekujace_ += linia;
+    if (okno_.count() > 0) {
+      zmiana_.notify_one();
+    }
+  }
+
+  void petla() {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    while (!koniec_) {
+      zmiana_.wait(blokada, [this] { return koniec_ || !oczekujace_.empty(); });
+      zmiana_.wait_for(blokada, okno_, [this] { return koniec_; });
+      if (!oczekujace_.empty()) {
+        std::string paczka = std::move(oczekujace_);
+        oczekujace_.clear();
+        blokada.unlock();
+        rozglos_wiadomosc(std::move(paczka));
+        blokada.lock();
+      }
+    }
+  }
+
+  static constexpr size_t kDlugoscHistorii = 256;
+  static constexpr size_t kLiczbaMigawek = 4;
+
+  blokady::Mutex<std::mutex> mutex_{profil_katalogu};
+  std::condition_variable_any zmiana_;
+  std::atomic<uint64_t> wersja_{0};
+  std::map<std::string, bool> pokoje_;
+  Migawka migawki_[kLiczbaMigawek];
+  std::atomic<Migawka*> migawka_{nullptr};
+  std::deque<std::pair<uint64_t, std::string>> historia_;
+  std::string oczekujace_;
+  std::chrono::milliseconds okno_{0};
+  bool rozsylanie_ = false;
+  bool koniec_ = false;
+  std::thread watek_;
+};
+
+KatalogPokoi katalog_pokoi;
 
-      if (linia == "/leave") {
-        std::string obecny_pokoj;
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          obecny_pokoj = klienci[gniazdo].pokoj;
+struct PomiarRuchu {
+  std::chrono::steady_clock::time_point chwila = std::chrono::steady_clock::now();
+  uint64_t przychodzace = 0;
+  uint64_t wychodzace = 0;
+};
+
+blokady::Mutex<std::mutex> mutex_pomiaru_ruchu(profil_pomiaru_ruchu);
+PomiarRuchu poprzedni_pomiar_ruchu;
+
+uint64_t aktywne_polaczenia() {
+  uint64_t zamkniete = metryki_serwera.polaczenia_zamkniete.wartosc();
+  uint64_t otwarte = metryki_serwera.polaczenia_otwarte.wartosc();
+  return otwarte > zamkniete ? otwarte - zamkniete : 0;
+}
+
+std::string raport_prometheus() {
+  const MetrykiSerwera& m = metryki_serwera;
+  std::string raport;
+  metryki::dopisz_miernik(&raport, "chat_connections", "Otwarte połączenia.",
+                          aktywne_polaczenia());
+  metryki::dopisz_licznik(&raport, "chat_connections_total", "Przyjęte połączenia.",
+                          m.polaczenia_otwarte.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_messages_received_total",
+                          "Linie i ramki odebrane od klientów.",
+                          m.wiadomosci_przychodzace.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_messages_sent_total",
+                          "Wiadomości dodane do kolejek wyjściowych.",
+                          m.wiadomosci_wychodzace.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_received_bytes_total", "Bajty odebrane od klientów.",
+                          m.bajty_przychodzace.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_sent_bytes_total", "Bajty wysłane do klientów.",
+                          m.bajty_wychodzace.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_send_syscalls_total",
+                          "Wywołania systemowe wysyłki (sendmsg/send, TCP_CORK).",
+                          m.wywolania_wysylki.wartosc());
+  metryki::dopisz_histogram(&raport, "chat_broadcast_recipients",
+                            "Liczba odbiorców jednego rozgłoszenia w pokoju.",
+                            m.odbiorcy_rozglaszania);
+  metryki::dopisz_histogram(&raport, "chat_broadcast_seconds",
+                            "Czas rozgłaszania wiadomości w pokoju.", m.czas_rozglaszania_ns,
+                            1e-9);
+  metryki::dopisz_licznik(&raport, "chat_rate_limited_connection_total",
+                          "Linie odrzucone przez limit połączenia.",
+                          m.ograniczone_polaczenia.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_rate_limited_room_total",
+                          "Wiadomości odrzucone przez limit pokoju.",
+                          m.ograniczone_pokoje.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_rate_limited_private_total",
+                          "Wiadomości prywatne odrzucone przez limit.",
+                          m.ograniczone_prywatne.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_presence_events_total",
+                          "Zdarzenia obecności (wyjścia, zmiany nazw, wejścia do pokoi).",
+                          m.zdarzenia_obecnosci.wartosc());
+  metryki::dopisz_licznik(&raport, "chat_presence_batches_total",
+                          "Paczki zdarzeń obecności wysłane do odbiorców.",
+                          m.paczki_obecnosci.wartosc());
+  metryki::dopisz_miernik(&raport, "chat_log_queue_depth", "Rekordy czekające na zapis logu.",
+                          potok_logu.glebokosc());
+  metryki::dopisz_licznik(&raport, "chat_log_dropped_total", "Rekordy logu odrzucone.",
+                          potok_logu.odrzucone());
+  metryki::dopisz_histogram(&raport, "chat_lock_wait_clients_seconds",
+                            "Oczekiwanie na blokady rejestrów klientów i połączeń.",
+                            m.oczekiwanie_klienci_ns, 1e-9);
+  metryki::dopisz_histogram(&raport, "chat_lock_wait_rooms_seconds",
+                            "Oczekiwanie na blokady rejestru i członków pokoi.",
+                            m.oczekiwanie_pokoje_ns, 1e-9);
+  metryki::dopisz_histogram(&raport, "chat_lock_wait_log_seconds",
+                            "Oczekiwanie na budzenie wątku logu.", m.oczekiwanie_logu_ns, 1e-9);
+  return raport;
+}
+
+void wyslij_statystyki(UchwytGniazda gniazdo) {
+  const MetrykiSerwera& m = metryki_serwera;
+  PomiarRuchu pomiar;
+  pomiar.przychodzace = m.wiadomosci_przychodzace.wartosc();
+  pomiar.wychodzace = m.wiadomosci_wychodzace.wartosc();
+  PomiarRuchu poprzedni;
+  {
+    blokady::Wylaczna<std::mutex> blokada(mutex_pomiaru_ruchu);
+    poprzedni = poprzedni_pomiar_ruchu;
+    poprzedni_pomiar_ruchu = pomiar;
+  }
+  double sekundy = std::max(
+      std::chrono::duration<double>(pomiar.chwila - poprzedni.chwila).count(), 1e-3);
+  std::ostringstream ruch;
+  ruch << std::fixed;
+  ruch.precision(1);
+  ruch << "Ruch: połączenia=" << aktywne_polaczenia()
+       << ", odebrane=" << pomiar.przychodzace << " ("
+       << static_cast<double>(pomiar.przychodzace - poprzedni.przychodzace) / sekundy
+       << "/s), wysłane=" << pomiar.wychodzace << " ("
+       << static_cast<double>(pomiar.wychodzace - poprzedni.wychodzace) / sekundy
+       << "/s), bajty odebrane=" << m.bajty_przychodzace.wartosc()
+       << ", bajty wysłane=" << m.bajty_wychodzace.wartosc();
+  wyslij_system(gniazdo, ruch.str());
+  uint64_t wywolania = m.wywolania_wysylki.wartosc();
+  std::ostringstream wysylka;
+  wysylka << std::fixed;
+  wysylka.precision(3);
+  wysylka << "Wysyłka: wywołania=" << wywolania << ", wiadomości=" << pomiar.wychodzace
+          << ", wywołań na wiadomość="
+          << static_cast<double>(wywolania) /
+                 static_cast<double>(std::max<uint64_t>(pomiar.wychodzace, 1));
+  wyslij_system(gniazdo, wysylka.str());
+  metryki::Histogram::Stan odbiorcy = m.odbiorcy_rozglaszania.stan();
+  metryki::Histogram::Stan czas = m.czas_rozglaszania_ns.stan();
+  std::ostringstream rozglaszanie;
+  rozglaszanie << "Rozgłaszanie: " << czas.liczba << " razy, odbiorcy p50<="
+               << metryki::kwantyl(odbiorcy, 0.5) << " p99<=" << metryki::kwantyl(odbiorcy, 0.99)
+               << ", czas p50<=" << metryki::kwantyl(czas, 0.5) / 1000
+               << " us p99<=" << metryki::kwantyl(czas, 0.99) / 1000 << " us";
+  wyslij_system(gniazdo, rozglaszanie.str());
+  wyslij_system(gniazdo, "Limity (odrzucone): połączenia=" +
+                             std::to_string(m.ograniczone_polaczenia.wartosc()) + ", pokoje=" +
+                             std::to_string(m.ograniczone_pokoje.wartosc()) + ", prywatne=" +
+                             std::to_string(m.ograniczone_prywatne.wartosc()));
+  wyslij_system(gniazdo, "Obecność: zdarzenia=" +
+                             std::to_string(m.zdarzenia_obecnosci.wartosc()) + ", paczki=" +
+                             std::to_string(m.paczki_obecnosci.wartosc()));
+  std::ostringstream blokady;
+  blokady << "Oczekiwanie na blokady (liczba, p99 w us): ";
+  const std::pair<const char*, const metryki::Histogram*> histogramy[] = {
+      {"klienci", &m.oczekiwanie_klienci_ns},
+      {"pokoje", &m.oczekiwanie_pokoje_ns},
+      {"log", &m.oczekiwanie_logu_ns},
+  };
+  bool pierwszy = true;
+  for (const auto& [nazwa, histogram] : histogramy) {
+    metryki::Histogram::Stan stan = histogram->stan();
+    blokady << (pierwszy ? "" : ", ") << nazwa << "=" << stan.liczba << "/"
+            << metryki::kwantyl(stan, 0.99) / 1000;
+    pierwszy = false;
+  }
+  wyslij_system(gniazdo, blokady.str());
+  std::ostringstream raport;
+  raport << "Kolejki wyjściowe: przepełnienia="
+         << liczniki_kolejek.przepelnienia.load(std::memory_order_relaxed)
+         << ", odrzucone wiadomości="
+         << liczniki_kolejek.odrzucone_wiadomosci.load(std::memory_order_relaxed)
+         << ", rozłączenia=" << liczniki_kolejek.rozlaczenia.load(std::memory_order_relaxed)
+         << ", oczekiwania=" << liczniki_kolejek.oczekiwania.load(std::memory_order_relaxed);
+  wyslij_system(gniazdo, raport.str());
+  wyslij_system(gniazdo, "Log: w kolejce=" + std::to_string(potok_logu.glebokosc()) +
+                             ", zapisane=" + std::to_string(potok_logu.zapisane()) +
+                             ", odrzucone=" + std::to_string(potok_logu.odrzucone()) +
+                             ", rotacje=" + std::to_string(potok_logu.rotacje()) +
+                             ", skompresowane=" + std::to_string(potok_logu.skompresowane()));
+}
+
+class SerwerMetryk {
+ public:
+  ~SerwerMetryk() { zatrzymaj(); }
+
+  bool uruchom(int port) {
+    gniazdo_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (gniazdo_ == kNieprawidloweGniazdo) {
+      return false;
+    }
+    int opcja = 1;
+#ifdef _WIN32
+    setsockopt(gniazdo_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opcja),
+               static_cast<int>(sizeof(opcja)));
+#else
+    setsockopt(gniazdo_, SOL_SOCKET, SO_REUSEADDR, &opcja, sizeof(opcja));
+#endif
+    sockaddr_in adres{};
+    adres.sin_family = AF_INET;
+    adres.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    adres.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(gniazdo_, reinterpret_cast<sockaddr*>(&adres), sizeof(adres)) < 0 ||
+        listen(gniazdo_, 16) < 0) {
+      zamknij_gniazdo(gniazdo_);
+      gniazdo_ = kNieprawidloweGniazdo;
+      return false;
+    }
+    watek_ = std::thread(&SerwerMetryk::petla, this);
+    return true;
+  }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    koniec_.store(true);
+#ifdef _WIN32
+    shutdown(gniazdo_, SD_BOTH);
+#else
+    shutdown(gniazdo_, SHUT_RDWR);
+#endif
+    zamknij_gniazdo(gniazdo_);
+    watek_.join();
+  }
+
+ private:
+  void petla() {
+    while (!koniec_.load()) {
+      UchwytGniazda klient = accept(gniazdo_, nullptr, nullptr);
+      if (klient == kNieprawidloweGniazdo) {
+#ifdef _WIN32
+        if (WSAGetLastError() == WSAEINTR) {
+          continue;
+        }
+#else
+        if (errno == EINTR) {
+          continue;
+        }
+#endif
+        return;
+      }
+      odpowiedz(klient);
+      zamknij_gniazdo(klient);
+    }
+  }
+
+  static void odpowiedz(UchwytGniazda klient) {
+#ifdef _WIN32
+    DWORD limit = 1000;
+    setsockopt(klient, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&limit),
+               static_cast<int>(sizeof(limit)));
+#else
+    timeval limit{1, 0};
+    setsockopt(klient, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+#endif
+    char zadanie[1024];
+    recv(klient, zadanie, static_cast<int>(sizeof(zadanie)), 0);
+    std::string tresc = raport_prometheus();
+    std::string odpowiedz =
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " +
+        std::to_string(tresc.size()) + "\r\nConnection: close\r\n\r\n" + tresc;
+    size_t wyslano = 0;
+    while (wyslano < odpowiedz.size()) {
+      RozmiarGniazda wynik = send(klient, odpowiedz.data() + wyslano,
+                                  static_cast<int>(odpowiedz.size() - wyslano), 0);
+      if (wynik <= 0) {
+        return;
+      }
+      wyslano += static_cast<size_t>(wynik);
+    }
+  }
+
+  UchwytGniazda gniazdo_ = kNieprawidloweGniazdo;
+  std::atomic<bool> koniec_{false};
+  std::thread watek_;
+};
+
+SerwerMetryk serwer_metryk;
+
+constexpr size_t kRaportowaneBlokady = 10;
+constexpr size_t kRaportowaneMiejsca = 3;
+
+void wypisz_raport_blokad() {
+  std::string raport = blokady::raport(kRaportowaneBlokady, kRaportowaneMiejsca);
+  std::cout << "Najgorętsze blokady:\n" << (raport.empty() ? "brak oczekiwań\n" : raport)
+            << std::flush;
+}
+
+class RaportBlokad {
+ public:
+  ~RaportBlokad() { zatrzymaj(); }
+
+  void uruchom(std::chrono::seconds okres) {
+    okres_ = okres;
+    watek_ = std::thread(&RaportBlokad::petla, this);
+  }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> blokada(mutex_);
+      koniec_ = true;
+    }
+    zmiana_.notify_one();
+    watek_.join();
+  }
+
+ private:
+  void petla() {
+    std::unique_lock<std::mutex> blokada(mutex_);
+    while (!zmiana_.wait_for(blokada, okres_, [this] { return koniec_; })) {
+      wypisz_raport_blokad();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable zmiana_;
+  std::chrono::seconds okres_{0};
+  bool koniec_ = false;
+  std::thread watek_;
+};
+
+RaportBlokad raport_blokad;
+
+bool zarezerwuj_nazwe(const std::string& nazwa, UchwytGniazda gniazdo) {
+  blokady::Wylaczna<std::shared_mutex> blokada(mutex_nazw);
+  return indeks_nazw.emplace(nazwa, gniazdo).second;
+}
+
+bool zmien_nazwe(const std::string& stara_nazwa,
+                 const std::string& nowa_nazwa,
+                 UchwytGniazda gniazdo) {
+  blokady::Wylaczna<std::shared_mutex> blokada(mutex_nazw);
+  if (!indeks_nazw.emplace(nowa_nazwa, gniazdo).second) {
+    return false;
+  }
+  auto iter = indeks_nazw.find(stara_nazwa);
+  if (iter != indeks_nazw.end() && iter->second == gniazdo) {
+    indeks_nazw.erase(iter);
+  }
+  return true;
+}
+
+void zwolnij_nazwe(const std::string& nazwa, UchwytGniazda gniazdo) {
+  blokady::Wylaczna<std::shared_mutex> blokada(mutex_nazw);
+  auto iter = indeks_nazw.find(nazwa);
+  if (iter != indeks_nazw.end() && iter->second == gniazdo) {
+    indeks_nazw.erase(iter);
+  }
+}
+
+UchwytGniazda znajdz_po_nazwie(const std::string& nazwa) {
+  blokady::Wspoldzielona<std::shared_mutex> blokada(mutex_nazw);
+  auto iter = indeks_nazw.find(nazwa);
+  return iter == indeks_nazw.end() ? kNieprawidloweGniazdo : iter->second;
+}
+
+bool czy_nazwa_bota(const std::string& nazwa) {
+  return nazwa.rfind("Bot", 0) == 0;
+}
+
+UchwytPokoju pokoj_sesji(const SesjaKlienta& sesja) {
+  return std::atomic_load(&sesja.pokoj);
+}
+
+void ustaw_pokoj_sesji(SesjaKlienta& sesja, UchwytPokoju pokoj) {
+  std::atomic_store(&sesja.pokoj, std::move(pokoj));
+}
+
+uint32_t identyfikator_uzytkownika(SesjaKlienta& sesja) {
+  if (sesja.id_uzytkownika == 0) {
+    sesja.id_uzytkownika = slownik_uzytkownikow.identyfikator(sesja.nazwa);
+  }
+  return sesja.id_uzytkownika;
+}
+
+UchwytPokoju znajdz_pokoj(const std::string& nazwa_pokoju) {
+  return pokoje.czytaj(nazwa_pokoju, [](const UchwytPokoju* pokoj) {
+    return pokoj ? *pokoj : nullptr;
+  });
+}
+
+UchwytPokoju utworz_pokoj(const std::string& nazwa_pokoju,
+                          const std::string& haslo,
+                          UchwytGniazda wlasciciel,
+                          int64_t utworzono_us) {
+  auto pokoj = std::make_shared<Pokoj>();
+  pokoj->id = slownik_pokoi.identyfikator(nazwa_pokoju);
+  pokoj->nazwa = nazwa_pokoju;
+  pokoj->haslo = haslo;
+  pokoj->wlasciciel = wlasciciel;
+  pokoj->utworzono_us = utworzono_us;
+  bool dodano = pokoje.zmien(nazwa_pokoju, [&](auto& mapa) {
+    if (!mapa.emplace(nazwa_pokoju, pokoj).second) {
+      return false;
+    }
+    if (wlasciciel != kNieprawidloweGniazdo) {
+      katalog_pokoi.dodano(nazwa_pokoju, !haslo.empty());
+    }
+    return true;
+  });
+  return dodano ? pokoj : nullptr;
+}
+
+bool dolacz_do_pokoju(UchwytGniazda klient, Pokoj& pokoj, const std::string& haslo) {
+  if (!pokoj.haslo.empty() && pokoj.haslo != haslo) {
+    return false;
+  }
+  blokady::Wylaczna<std::shared_mutex> blokada(pokoj.mutex);
+  if (pokoj.usuniety) {
+    return false;
+  }
+  if (pokoj.czlonkowie.wstaw(klient)) {
+    pokoj.migawka_czlonkow.reset();
+  }
+  return true;
+}
+
+void opusc_pokoj(UchwytGniazda klient, Pokoj& pokoj) {
+  blokady::Wylaczna<std::shared_mutex> blokada(pokoj.mutex);
+  if (pokoj.czlonkowie.usun(klient)) {
+    pokoj.migawka_czlonkow.reset();
+  }
+}
+
+constexpr size_t kMaksSubskrypcji = 64;
+
+enum class WynikSubskrypcji {
+  Dolaczono,
+  JuzCzlonek,
+  Odmowa,
+  Limit,
+};
+
+WynikSubskrypcji subskrybuj(SesjaKlienta& sesja,
+                            const UchwytPokoju& pokoj,
+                            const std::string& haslo) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  auto& subskrypcje = sesja.subskrypcje;
+  if (std::find(subskrypcje.begin(), subskrypcje.end(), pokoj) != subskrypcje.end()) {
+    ustaw_pokoj_sesji(sesja, pokoj);
+    return WynikSubskrypcji::JuzCzlonek;
+  }
+  if (subskrypcje.size() >= kMaksSubskrypcji) {
+    return WynikSubskrypcji::Limit;
+  }
+  if (!dolacz_do_pokoju(sesja.gniazdo, *pokoj, haslo)) {
+    return WynikSubskrypcji::Odmowa;
+  }
+  subskrypcje.push_back(pokoj);
+  ustaw_pokoj_sesji(sesja, pokoj);
+  return WynikSubskrypcji::Dolaczono;
+}
+
+UchwytPokoju znajdz_subskrypcje(SesjaKlienta& sesja, std::string_view nazwa_pokoju) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  for (const UchwytPokoju& pokoj : sesja.subskrypcje) {
+    if (pokoj->nazwa == nazwa_pokoju) {
+      return pokoj;
+    }
+  }
+  return nullptr;
+}
+
+size_t liczba_subskrypcji(SesjaKlienta& sesja) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  return sesja.subskrypcje.size();
+}
+
+enum class WynikWypisania {
+  Wypisano,
+  NieCzlonek,
+  OstatniPokoj,
+};
+
+// Sesja zawsze należy do co najmniej jednego pokoju: wypisanie z ostatniego przenosi
+// do Lobby, jak /leave, a z samego Lobby jest odrzucane.
+WynikWypisania wypisz_z_pokoju(SesjaKlienta& sesja,
+                               const UchwytPokoju& pokoj,
+                               bool* zmieniono_aktywny) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  auto& subskrypcje = sesja.subskrypcje;
+  auto iter = std::find(subskrypcje.begin(), subskrypcje.end(), pokoj);
+  if (iter == subskrypcje.end()) {
+    return WynikWypisania::NieCzlonek;
+  }
+  if (subskrypcje.size() == 1 && pokoj == lobby) {
+    return WynikWypisania::OstatniPokoj;
+  }
+  subskrypcje.erase(iter);
+  opusc_pokoj(sesja.gniazdo, *pokoj);
+  if (subskrypcje.empty()) {
+    dolacz_do_pokoju(sesja.gniazdo, *lobby, "");
+    subskrypcje.push_back(lobby);
+  }
+  *zmieniono_aktywny = pokoj_sesji(sesja) == pokoj;
+  if (*zmieniono_aktywny) {
+    if (std::find(subskrypcje.begin(), subskrypcje.end(), lobby) != subskrypcje.end()) {
+      ustaw_pokoj_sesji(sesja, lobby);
+    } else {
+      ustaw_pokoj_sesji(sesja, subskrypcje.front());
+    }
+  }
+  return WynikWypisania::Wypisano;
+}
+
+bool wypisz_z_usunietego(SesjaKlienta& sesja, const UchwytPokoju& pokoj) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  auto& subskrypcje = sesja.subskrypcje;
+  subskrypcje.erase(std::remove(subskrypcje.begin(), subskrypcje.end(), pokoj), subskrypcje.end());
+  if (pokoj_sesji(sesja) != pokoj) {
+    return false;
+  }
+  if (std::find(subskrypcje.begin(), subskrypcje.end(), lobby) == subskrypcje.end()) {
+    dolacz_do_pokoju(sesja.gniazdo, *lobby, "");
+    subskrypcje.push_back(lobby);
+  }
+  ustaw_pokoj_sesji(sesja, lobby);
+  return true;
+}
+
+std::vector<UchwytPokoju> wypisz_ze_wszystkich(SesjaKlienta& sesja) {
+  blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+  std::vector<UchwytPokoju> subskrypcje;
+  subskrypcje.swap(sesja.subskrypcje);
+  ustaw_pokoj_sesji(sesja, nullptr);
+  for (const UchwytPokoju& pokoj : subskrypcje) {
+    opusc_pokoj(sesja.gniazdo, *pokoj);
+  }
+  return subskrypcje;
+}
+
+enum class WynikUsunieciaPokoju {
+  Sukces,
+  NieZnaleziono,
+  NieWlasciciel,
+  Lobby,
+};
+
+WynikUsunieciaPokoju usun_pokoj(const std::string& nazwa_pokoju,
+                               UchwytGniazda proszacy,
+                               UchwytPokoju* usuniety,
+                               std::vector<UchwytGniazda>* czlonkowie) {
+  return pokoje.zmien(nazwa_pokoju, [&](auto& mapa) {
+    auto iter = mapa.find(nazwa_pokoju);
+    if (iter == mapa.end()) {
+      return WynikUsunieciaPokoju::NieZnaleziono;
+    }
+    if (iter->second == lobby) {
+      return WynikUsunieciaPokoju::Lobby;
+    }
+    if (iter->second->wlasciciel != proszacy) {
+      return WynikUsunieciaPokoju::NieWlasciciel;
+    }
+    *usuniety = std::move(iter->second);
+    mapa.erase(iter);
+    katalog_pokoi.usunieto(nazwa_pokoju);
+    blokady::Wylaczna<std::shared_mutex> blokada((*usuniety)->mutex, "usun_pokoj");
+    (*usuniety)->usuniety = true;
+    *czlonkowie = (*usuniety)->czlonkowie.elementy();
+    (*usuniety)->czlonkowie.wyczysc();
+    (*usuniety)->migawka_czlonkow.reset();
+    return WynikUsunieciaPokoju::Sukces;
+  });
+}
+
+std::shared_ptr<const std::vector<UchwytGniazda>> migawka_czlonkow(Pokoj& pokoj) {
+  {
+    blokady::Wspoldzielona<std::shared_mutex> blokada(pokoj.mutex);
+    if (pokoj.migawka_czlonkow) {
+      return pokoj.migawka_czlonkow;
+    }
+  }
+  blokady::Wylaczna<std::shared_mutex> blokada(pokoj.mutex);
+  if (!pokoj.migawka_czlonkow) {
+    pokoj.migawka_czlonkow =
+        std::make_shared<const std::vector<UchwytGniazda>>(pokoj.czlonkowie.elementy());
+  }
+  return pokoj.migawka_czlonkow;
+}
+
+void rozglos_wiadomosc_pokoju(Pokoj& pokoj,
+                             const Wiadomosc& wiadomosc,
+                             UchwytGniazda wyklucz_gniazdo = kNieprawidloweGniazdo) {
+  auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<const std::vector<UchwytGniazda>> czlonkowie = migawka_czlonkow(pokoj);
+  wyslij_do_wielu(*czlonkowie, wiadomosc, wyklucz_gniazdo);
+  metryki_serwera.odbiorcy_rozglaszania.zapisz(czlonkowie->size());
+  metryki_serwera.czas_rozglaszania_ns.zapisz_czas(start);
+}
+
+class Obecnosc {
+ public:
+  ~Obecnosc() { zatrzymaj(); }
+
+  void uruchom(std::chrono::milliseconds okno, bool globalna) {
+    okno_ = okno;
+    globalna_ = globalna;
+    if (okno_.count() > 0) {
+      watek_ = std::thread(&Obecnosc::petla, this);
+    }
+  }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    {
+      blokady::Wylaczna<std::mutex> blokada(mutex_);
+      koniec_ = true;
+    }
+    zmiana_.notify_one();
+    watek_.join();
+  }
+
+  void opuszczono_czat(UchwytGniazda gniazdo, const std::string& nazwa) {
+    if (globalna_) {
+      dodaj(nullptr, {Rodzaj::Wyjscie, gniazdo, nazwa, {}});
+    }
+  }
+
+  void zmieniono_nazwe(UchwytGniazda gniazdo, const std::string& stara, const std::string& nowa) {
+    if (globalna_) {
+      dodaj(nullptr, {Rodzaj::ZmianaNazwy, gniazdo, stara, nowa});
+    }
+  }
+
+  void dolaczono_do_pokoju(const UchwytPokoju& pokoj,
+                           UchwytGniazda gniazdo,
+                           const std::string& nazwa) {
+    dodaj(pokoj, {Rodzaj::Dolaczenie, gniazdo, nazwa, {}});
+  }
+
+  void opuszczono_pokoj(const UchwytPokoju& pokoj,
+                        UchwytGniazda gniazdo,
+                        const std::string& nazwa) {
+    dodaj(pokoj, {Rodzaj::OpuszczeniePokoju, gniazdo, nazwa, {}});
+  }
+
+ private:
+  enum class Rodzaj { Wyjscie, ZmianaNazwy, Dolaczenie, OpuszczeniePokoju, Anulowane };
+
+  struct Zdarzenie {
+    Rodzaj rodzaj;
+    UchwytGniazda gniazdo;
+    std::string nazwa;
+    std::string nowa_nazwa;
+  };
+
+  struct Paczka {
+    UchwytPokoju pokoj;
+    std::vector<Zdarzenie> zdarzenia;
+    std::unordered_map<UchwytGniazda, size_t> ostatnie;
+  };
+
+  void dodaj(const UchwytPokoju& pokoj, Zdarzenie zdarzenie) {
+    metryki_serwera.zdarzenia_obecnosci.dodaj();
+    if (okno_.count() == 0) {
+      Paczka paczka{pokoj, {std::move(zdarzenie)}, {}};
+      dostarcz(paczka);
+      return;
+    }
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    Paczka& paczka = oczekujace_[pokoj.get()];
+    paczka.pokoj = pokoj;
+    scal(paczka, std::move(zdarzenie));
+    zmiana_.notify_one();
+  }
+
+  static void scal(Paczka& paczka, Zdarzenie zdarzenie) {
+    auto ostatnie = paczka.ostatnie.find(zdarzenie.gniazdo);
+    if (ostatnie != paczka.ostatnie.end()) {
+      Zdarzenie& poprzednie = paczka.zdarzenia[ostatnie->second];
+      if (poprzednie.rodzaj == Rodzaj::ZmianaNazwy && poprzednie.nowa_nazwa == zdarzenie.nazwa) {
+        if (zdarzenie.rodzaj == Rodzaj::Wyjscie) {
+          poprzednie.rodzaj = Rodzaj::Wyjscie;
+          return;
+        }
+        if (zdarzenie.rodzaj == Rodzaj::ZmianaNazwy) {
+          poprzednie.nowa_nazwa = std::move(zdarzenie.nowa_nazwa);
+          if (poprzednie.nowa_nazwa == poprzednie.nazwa) {
+            poprzednie.rodzaj = Rodzaj::Anulowane;
+            paczka.ostatnie.erase(ostatnie);
+          }
+          return;
+        }
+      }
+      bool przeciwne = (poprzednie.rodzaj == Rodzaj::Dolaczenie &&
+                        zdarzenie.rodzaj == Rodzaj::OpuszczeniePokoju) ||
+                       (poprzednie.rodzaj == Rodzaj::OpuszczeniePokoju &&
+                        zdarzenie.rodzaj == Rodzaj::Dolaczenie);
+      if (przeciwne && poprzednie.nazwa == zdarzenie.nazwa) {
+        poprzednie.rodzaj = Rodzaj::Anulowane;
+        paczka.ostatnie.erase(ostatnie);
+        return;
+      }
+    }
+    paczka.ostatnie[zdarzenie.gniazdo] = paczka.zdarzenia.size();
+    paczka.zdarzenia.push_back(std::move(zdarzenie));
+  }
+
+  static std::string linia(const Paczka& paczka, const Zdarzenie& zdarzenie) {
+    switch (zdarzenie.rodzaj) {
+      case Rodzaj::Wyjscie:
+        return "[system] " + zdarzenie.nazwa + " opuścił czat.\n";
+      case Rodzaj::ZmianaNazwy:
+        return "[system] " + zdarzenie.nazwa + " ma teraz nazwę " + zdarzenie.nowa_nazwa + ".\n";
+      case Rodzaj::Dolaczenie:
+        return "[system] " + zdarzenie.nazwa + " dołączył do pokoju " + paczka.pokoj->nazwa +
+               ".\n";
+      case Rodzaj::OpuszczeniePokoju:
+        return "[system] " + zdarzenie.nazwa + " opuścił pokój " + paczka.pokoj->nazwa + ".\n";
+      case Rodzaj::Anulowane:
+        break;
+    }
+    return {};
+  }
+
+  static std::string tekst_bez(const Paczka& paczka, UchwytGniazda pomijany) {
+    std::string tekst;
+    for (const Zdarzenie& zdarzenie : paczka.zdarzenia) {
+      if (zdarzenie.rodzaj != Rodzaj::Dolaczenie || zdarzenie.gniazdo != pomijany) {
+        tekst += linia(paczka, zdarzenie);
+      }
+    }
+    return tekst;
+  }
+
+  static std::string blok_bez(const Paczka& paczka,
+                              const std::vector<const Zdarzenie*>& dolaczenia,
+                              size_t blok,
+                              UchwytGniazda pomijany) {
+    std::string tekst;
+    size_t koniec = std::min((blok + 1) * kLimitOsobnychPaczek, dolaczenia.size());
+    for (size_t i = blok * kLimitOsobnychPaczek; i < koniec; ++i) {
+      if (dolaczenia[i]->gniazdo != pomijany) {
+        tekst += linia(paczka, *dolaczenia[i]);
+      }
+    }
+    return tekst;
+  }
+
+  // Małą paczkę dołączający dostaje złożoną osobno, bez własnej linii. W dużej linie
+  // dołączeń idą na końcu wspólnymi blokami po kLimitOsobnychPaczek, a dołączającemu
+  // składany jest od nowa tylko blok z jego linią.
+  static void dostarcz(const Paczka& paczka) {
+    size_t liczba_linii = 0;
+    std::vector<const Zdarzenie*> dolaczenia;
+    for (const Zdarzenie& zdarzenie : paczka.zdarzenia) {
+      if (zdarzenie.rodzaj == Rodzaj::Anulowane) {
+        continue;
+      }
+      ++liczba_linii;
+      if (zdarzenie.rodzaj == Rodzaj::Dolaczenie) {
+        dolaczenia.push_back(&zdarzenie);
+      }
+    }
+    if (liczba_linii == 0) {
+      return;
+    }
+    bool osobne = liczba_linii <= kLimitOsobnychPaczek;
+    std::string tekst;
+    for (const Zdarzenie& zdarzenie : paczka.zdarzenia) {
+      if (osobne || zdarzenie.rodzaj != Rodzaj::Dolaczenie) {
+        tekst += linia(paczka, zdarzenie);
+      }
+    }
+    std::vector<Wiadomosc> bloki;
+    std::unordered_map<UchwytGniazda, size_t> blok_dolaczajacego;
+    for (size_t i = 0; i < dolaczenia.size(); ++i) {
+      blok_dolaczajacego[dolaczenia[i]->gniazdo] = i / kLimitOsobnychPaczek;
+    }
+    if (!osobne) {
+      for (size_t blok = 0; blok * kLimitOsobnychPaczek < dolaczenia.size(); ++blok) {
+        bloki.push_back(wiadomosc_tekstowa(blok_bez(paczka, dolaczenia, blok,
+                                                    kNieprawidloweGniazdo)));
+      }
+    }
+    std::vector<std::pair<UchwytGniazda, std::shared_ptr<Polaczenie>>> odbiorcy;
+    if (paczka.pokoj) {
+      for (UchwytGniazda gniazdo : *migawka_czlonkow(*paczka.pokoj)) {
+        if (std::shared_ptr<Polaczenie> polaczenie = znajdz_polaczenie(gniazdo)) {
+          odbiorcy.emplace_back(gniazdo, std::move(polaczenie));
+        }
+      }
+    } else {
+      polaczenia.dla_kazdego(
+          [&](UchwytGniazda gniazdo, const std::shared_ptr<Polaczenie>& polaczenie) {
+            odbiorcy.emplace_back(gniazdo, polaczenie);
+          });
+    }
+    Wiadomosc wspolna = wiadomosc_tekstowa(std::move(tekst));
+    for (const auto& [gniazdo, polaczenie] : odbiorcy) {
+      auto wlasny_blok = blok_dolaczajacego.find(gniazdo);
+      if (osobne && wlasny_blok != blok_dolaczajacego.end()) {
+        std::string wlasny = tekst_bez(paczka, gniazdo);
+        if (!wlasny.empty()) {
+          kolejkuj_wysylke(*polaczenie, wiadomosc_tekstowa(std::move(wlasny)));
+        }
+        continue;
+      }
+      kolejkuj_wysylke(*polaczenie, wspolna);
+      for (size_t blok = 0; blok < bloki.size(); ++blok) {
+        if (wlasny_blok == blok_dolaczajacego.end() || wlasny_blok->second != blok) {
+          kolejkuj_wysylke(*polaczenie, bloki[blok]);
+          continue;
+        }
+        std::string wlasny = blok_bez(paczka, dolaczenia, blok, gniazdo);
+        if (!wlasny.empty()) {
+          kolejkuj_wysylke(*polaczenie, wiadomosc_tekstowa(std::move(wlasny)));
+        }
+      }
+    }
+    metryki_serwera.paczki_obecnosci.dodaj(odbiorcy.size());
+  }
+
+  void petla() {
+    blokady::Wylaczna<std::mutex> blokada(mutex_);
+    while (!koniec_) {
+      zmiana_.wait(blokada, [this] { return koniec_ || !oczekujace_.empty(); });
+      zmiana_.wait_for(blokada, okno_, [this] { return koniec_; });
+      std::unordered_map<const Pokoj*, Paczka> gotowe;
+      gotowe.swap(oczekujace_);
+      blokada.unlock();
+      if (!zamykanie.load(std::memory_order_relaxed)) {
+        for (const auto& [pokoj, paczka] : gotowe) {
+          dostarcz(paczka);
+        }
+      }
+      blokada.lock();
+    }
+  }
+
+  static constexpr size_t kLimitOsobnychPaczek = 64;
+
+  blokady::Mutex<std::mutex> mutex_{profil_obecnosci};
+  std::condition_variable_any zmiana_;
+  std::unordered_map<const Pokoj*, Paczka> oczekujace_;
+  std::chrono::milliseconds okno_{0};
+  bool globalna_ = true;
+  bool koniec_ = false;
+  std::thread watek_;
+};
+
+Obecnosc obecnosc;
+
+constexpr size_t kRozmiarStronyHistorii = 20;
+
+bool wyslij_historie(UchwytGniazda gniazdo, const Pokoj& pokoj, size_t strona, size_t rozmiar) {
+  std::string ladunek = "[system] Historia pokoju " + pokoj.nazwa + ", strona " +
+                        std::to_string(strona + 1) + ":\n";
+  std::string z_pierscienia;
+  size_t w_pierscieniu = 0;
+  int64_t najstarszy_us = 0;
+  size_t pomin = strona * rozmiar;
+  size_t liczba = pokoj.historia.dopisz_strone(pomin, rozmiar, &z_pierscienia, &w_pierscieniu,
+                                               &najstarszy_us);
+  if (liczba < rozmiar && magazyn_wiadomosci.otwarty()) {
+    liczba += magazyn_wiadomosci.ostatnie_w_pokoju(
+        pokoj.id, pokoj.utworzono_us, najstarszy_us,
+        pomin > w_pierscieniu ? pomin - w_pierscieniu : 0, rozmiar - liczba,
+        [&](const magazyn::Rekord& rekord) {
+          ladunek.append(rekord.tresc);
+          ladunek += '\n';
+        });
+  }
+  if (liczba == 0) {
+    return false;
+  }
+  ladunek += z_pierscienia;
+  wyslij_wszystko(gniazdo, std::move(ladunek));
+  return true;
+}
+
+void rozpocznij_sesje(SesjaKlienta& sesja, int id_klienta) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  sesja.nazwa = "gość" + std::to_string(id_klienta);
+  for (int proba = 2; !zarezerwuj_nazwe(sesja.nazwa, gniazdo); ++proba) {
+    sesja.nazwa = "gość" + std::to_string(id_klienta) + "-" + std::to_string(proba);
+  }
+  klienci.zmien(gniazdo, [&](auto& mapa) { mapa[gniazdo] = {gniazdo, sesja.nazwa}; });
+  subskrybuj(sesja, lobby, "");
+  wyslij_przypisanie_pokoju(gniazdo, lobby->nazwa);
+  katalog_pokoi.wyslij_stan(gniazdo, std::nullopt);
+
+  wyslij_system(gniazdo, "Witaj! Ustaw nazwę poleceniem /name <nick>.");
+  wyslij_system(gniazdo, "Użyj /msg <użytkownik> <wiadomość> do prywatnych czatów.");
+  wyslij_system(gniazdo,
+                "Pokoje: /create <pokój> [hasło], /join <pokój> [hasło], /part <pokój>, "
+                "/leave, /delete <pokój>, /say <pokój> <wiadomość>, /joined.");
+
+  zapisz_log(sesja.nazwa + " dołączył do pokoju Lobby.");
+}
+
+void komenda_nazwa(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string& nazwa_klienta = sesja.nazwa;
+  std::string nowa_nazwa(argumenty);
+  if (nowa_nazwa.empty()) {
+    wyslij_system(gniazdo, "Nazwa nie może być pusta.");
+    return;
+  }
+  if (nowa_nazwa == nazwa_klienta || !zmien_nazwe(nazwa_klienta, nowa_nazwa, gniazdo)) {
+    wyslij_system(gniazdo, "Nazwa jest już zajęta.");
+    return;
+  }
+  klienci.zmien(gniazdo, [&](auto& mapa) { mapa[gniazdo].nazwa = nowa_nazwa; });
+  if (!czy_nazwa_bota(nowa_nazwa)) {
+    obecnosc.zmieniono_nazwe(gniazdo, nazwa_klienta, nowa_nazwa);
+  }
+  zapisz_log(nazwa_klienta + " zmienił nazwę na " + nowa_nazwa);
+  nazwa_klienta = nowa_nazwa;
+  sesja.id_uzytkownika = 0;
+}
+
+constexpr uint8_t kLimitPolaczenia = 1;
+constexpr uint8_t kLimitPokoju = 2;
+constexpr uint8_t kLimitPrywatnych = 4;
+
+bool zglos_limit(SesjaKlienta& sesja,
+                 uint8_t rodzaj,
+                 bool przepuszczono,
+                 metryki::Licznik& odrzucone,
+                 const char* komunikat) {
+  if (przepuszczono) {
+    sesja.zgloszone_limity &= static_cast<uint8_t>(~rodzaj);
+    return true;
+  }
+  odrzucone.dodaj();
+  if ((sesja.zgloszone_limity & rodzaj) == 0) {
+    sesja.zgloszone_limity |= rodzaj;
+    wyslij_system(sesja.gniazdo, komunikat);
+  }
+  return false;
+}
+
+bool w_limicie_polaczenia(SesjaKlienta& sesja) {
+  const limity::Limit& limit = ustawienia_limitow.polaczenie;
+  return !limit.wlaczony() ||
+         zglos_limit(sesja, kLimitPolaczenia,
+                     sesja.limit_wiadomosci.pobierz(limit, limity::teraz_ns()),
+                     metryki_serwera.ograniczone_polaczenia,
+                     "Za dużo wiadomości. Nadmiarowe linie są odrzucane.");
+}
+
+bool w_limicie_pokoju(SesjaKlienta& sesja, Pokoj& pokoj) {
+  const limity::Limit& limit = ustawienia_limitow.pokoj;
+  return !limit.wlaczony() ||
+         zglos_limit(sesja, kLimitPokoju, pokoj.limit.pobierz(limit, limity::teraz_ns()),
+                     metryki_serwera.ograniczone_pokoje,
+                     "Pokój przekroczył limit wiadomości. Spróbuj za chwilę.");
+}
+
+bool w_limicie_prywatnych(SesjaKlienta& sesja) {
+  const limity::Limit& limit = ustawienia_limitow.prywatne;
+  return !limit.wlaczony() ||
+         zglos_limit(sesja, kLimitPrywatnych,
+                     sesja.limit_prywatnych.pobierz(limit, limity::teraz_ns()),
+                     metryki_serwera.ograniczone_prywatne,
+                     "Za dużo wiadomości prywatnych. Spróbuj za chwilę.");
+}
+
+void komenda_prywatna(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda nadawca = sesja.gniazdo;
+  const std::string& nazwa_nadawcy = sesja.nazwa;
+  std::string_view odbiorca = komendy::nastepny_token(&argumenty);
+  std::string_view wiadomosc = komendy::przytnij(argumenty);
+
+  if (odbiorca.empty() || wiadomosc.empty()) {
+    wyslij_system(nadawca, "Użycie: /msg <użytkownik> <wiadomość>");
+    return;
+  }
+  if (!w_limicie_prywatnych(sesja)) {
+    return;
+  }
+
+  std::string nazwa_odbiorcy(odbiorca);
+  UchwytGniazda gniazdo_odbiorcy = znajdz_po_nazwie(nazwa_odbiorcy);
+
+  if (gniazdo_odbiorcy == kNieprawidloweGniazdo) {
+    wyslij_system(nadawca, "Nie znaleziono użytkownika: " + nazwa_odbiorcy);
+    return;
+  }
+
+  std::string tresc = "[private] " + nazwa_nadawcy + ": ";
+  tresc.append(wiadomosc);
+  tresc += '\n';
+  Wiadomosc sformatowana{zbuduj_bufor(std::move(tresc))};
+  if (sa_klienci_binarni()) {
+    sformatowana.id_nadawcy = identyfikator_uzytkownika(sesja);
+    sformatowana.id_odbiorcy = slownik_uzytkownikow.identyfikator(nazwa_odbiorcy);
+    std::string ramka;
+    protokol::dopisz_ramke(&ramka, protokol::TypRamki::WiadomoscPrywatna,
+                           {sformatowana.id_nadawcy, sformatowana.id_odbiorcy}, wiadomosc);
+    sformatowana.ramki = zbuduj_bufor(std::move(ramka));
+  }
+  wyslij_bufor(gniazdo_odbiorcy, sformatowana);
+  wyslij_bufor(nadawca, sformatowana);
+  std::string wpis = "[private] " + nazwa_nadawcy + " -> " + nazwa_odbiorcy + ": ";
+  wpis.append(wiadomosc);
+  zapisz_log(wpis, {magazyn::TypRekordu::WiadomoscPrywatna, 0, identyfikator_uzytkownika(sesja),
+                    slownik_uzytkownikow.identyfikator(nazwa_odbiorcy)});
+}
+
+void komenda_pokoje(SesjaKlienta& sesja, std::string_view argumenty) {
+  std::optional<uint64_t> wersja_klienta;
+  if (!argumenty.empty()) {
+    uint64_t wersja = 0;
+    for (char znak : argumenty) {
+      if (znak < '0' || znak > '9') {
+        wyslij_system(sesja.gniazdo, "Użycie: /rooms [wersja]");
+        return;
+      }
+      wersja = wersja * 10 + static_cast<uint64_t>(znak - '0');
+    }
+    wersja_klienta = wersja;
+  }
+  katalog_pokoi.wyslij_stan(sesja.gniazdo, wersja_klienta);
+}
+
+void komenda_statystyki(SesjaKlienta& sesja, std::string_view) {
+  wyslij_statystyki(sesja.gniazdo);
+}
+
+void komenda_blokady(SesjaKlienta& sesja, std::string_view) {
+  if (!blokady::profilowanie_wlaczone()) {
+    wyslij_system(sesja.gniazdo, "Profilowanie blokad jest wyłączone (opcja --lock-profile).");
+    return;
+  }
+  std::string raport = blokady::raport(kRaportowaneBlokady, kRaportowaneMiejsca);
+  wyslij_wszystko(sesja.gniazdo, "[system] Najgorętsze blokady:\n" +
+                                     (raport.empty() ? "brak oczekiwań\n" : raport));
+}
+
+void komenda_historia(SesjaKlienta& sesja, std::string_view argumenty) {
+  size_t strona = 1;
+  if (!argumenty.empty()) {
+    strona = 0;
+    for (char znak : argumenty) {
+      if (znak < '0' || znak > '9' || strona > 1000000) {
+        strona = 0;
+        break;
+      }
+      strona = strona * 10 + static_cast<size_t>(znak - '0');
+    }
+    if (strona == 0) {
+      wyslij_system(sesja.gniazdo, "Użycie: /history [strona]");
+      return;
+    }
+  }
+  UchwytPokoju pokoj = pokoj_sesji(sesja);
+  if (!pokoj || !wyslij_historie(sesja.gniazdo, *pokoj, strona - 1, kRozmiarStronyHistorii)) {
+    wyslij_system(sesja.gniazdo, "Brak wiadomości na tej stronie historii.");
+  }
+}
+
+void komenda_protokol(SesjaKlienta& sesja, std::string_view argumenty) {
+  if (argumenty != protokol::kNazwaBinarnego) {
+    wyslij_system(sesja.gniazdo, "Obsługiwane protokoły: " +
+                                     std::string(protokol::kNazwaBinarnego) + ".");
+    return;
+  }
+  if (std::shared_ptr<Polaczenie> polaczenie = znajdz_polaczenie(sesja.gniazdo)) {
+    przelacz_na_binarny(*polaczenie);
+    sesja.binarny = true;
+  }
+}
+
+void wyslij_do_pokoju(SesjaKlienta& sesja, Pokoj& pokoj, std::string_view tresc) {
+  if (!w_limicie_pokoju(sesja, pokoj)) {
+    return;
+  }
+
+  std::string wpis = "[" + pokoj.nazwa + "] " + sesja.nazwa + ": ";
+  wpis.append(tresc);
+  wpis += '\n';
+  int64_t czas_us =
+      pokoj.historia.dopisz(wpis, zegar_znacznikow.mikrosekundy(std::chrono::steady_clock::now()));
+  zapisz_log(wpis.substr(0, wpis.size() - 1), {magazyn::TypRekordu::WiadomoscPokoju, pokoj.id,
+                                               identyfikator_uzytkownika(sesja), 0, czas_us});
+  Wiadomosc wiadomosc{zbuduj_bufor(std::move(wpis))};
+  if (sa_klienci_binarni()) {
+    wiadomosc.id_pokoju = pokoj.id;
+    wiadomosc.id_nadawcy = identyfikator_uzytkownika(sesja);
+    std::string ramka;
+    protokol::dopisz_ramke(&ramka, protokol::TypRamki::WiadomoscPokoju,
+                           {wiadomosc.id_pokoju, wiadomosc.id_nadawcy}, tresc);
+    wiadomosc.ramki = zbuduj_bufor(std::move(ramka));
+  }
+  rozglos_wiadomosc_pokoju(pokoj, wiadomosc);
+}
+
+void wyslij_do_pokoju(SesjaKlienta& sesja, std::string_view tresc) {
+  UchwytPokoju obecny_pokoj = pokoj_sesji(sesja);
+  if (!obecny_pokoj) {
+    wyslij_system(sesja.gniazdo, "Dołącz do pokoju zanim zaczniesz pisać.");
+    return;
+  }
+  wyslij_do_pokoju(sesja, *obecny_pokoj, tresc);
+}
+
+void dolaczono_do_pokoju(SesjaKlienta& sesja, const UchwytPokoju& pokoj) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  const std::string& nazwa_klienta = sesja.nazwa;
+  wyslij_przypisanie_pokoju(gniazdo, pokoj->nazwa);
+  if (ustawienia_historii.odtwarzane > 0) {
+    wyslij_historie(gniazdo, *pokoj, 0, ustawienia_historii.odtwarzane);
+  }
+  if (!czy_nazwa_bota(nazwa_klienta)) {
+    obecnosc.dolaczono_do_pokoju(pokoj, gniazdo, nazwa_klienta);
+  }
+  zapisz_log(nazwa_klienta + " dołączył do pokoju " + pokoj->nazwa);
+}
+
+void wyslij_limit_subskrypcji(UchwytGniazda gniazdo) {
+  wyslij_system(gniazdo, "Możesz należeć najwyżej do " + std::to_string(kMaksSubskrypcji) +
+                             " pokoi. Opuść któryś poleceniem /part <pokój>.");
+}
+
+void komenda_utworz(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string nazwa_pokoju(komendy::nastepny_token(&argumenty));
+  std::string haslo(komendy::nastepny_token(&argumenty));
+  if (nazwa_pokoju.empty()) {
+    wyslij_system(gniazdo, "Użycie: /create <pokój> [hasło]");
+    return;
+  }
+  if (liczba_subskrypcji(sesja) >= kMaksSubskrypcji) {
+    wyslij_limit_subskrypcji(gniazdo);
+    return;
+  }
+  UchwytPokoju pokoj = utworz_pokoj(nazwa_pokoju, haslo, gniazdo,
+                                    zegar_znacznikow.mikrosekundy(std::chrono::steady_clock::now()));
+  if (!pokoj) {
+    wyslij_system(gniazdo, "Pokój już istnieje.");
+    return;
+  }
+  katalog_pokoi.rozeslij();
+  if (subskrybuj(sesja, pokoj, haslo) != WynikSubskrypcji::Dolaczono) {
+    wyslij_system(gniazdo, "Pokój utworzony, ale nie udało się dołączyć.");
+    return;
+  }
+  dolaczono_do_pokoju(sesja, pokoj);
+  wyslij_system(gniazdo, "Pokój utworzony i dołączono: " + nazwa_pokoju);
+}
+
+void komenda_dolacz(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string nazwa_pokoju(komendy::nastepny_token(&argumenty));
+  std::string haslo(komendy::nastepny_token(&argumenty));
+  if (nazwa_pokoju.empty()) {
+    wyslij_system(gniazdo, "Użycie: /join <pokój> [hasło]");
+    return;
+  }
+  UchwytPokoju pokoj = znajdz_pokoj(nazwa_pokoju);
+  switch (pokoj ? subskrybuj(sesja, pokoj, haslo) : WynikSubskrypcji::Odmowa) {
+    case WynikSubskrypcji::Dolaczono:
+      dolaczono_do_pokoju(sesja, pokoj);
+      break;
+    case WynikSubskrypcji::JuzCzlonek:
+      wyslij_przypisanie_pokoju(gniazdo, pokoj->nazwa);
+      break;
+    case WynikSubskrypcji::Odmowa:
+      wyslij_system(gniazdo, "Nie można dołączyć do pokoju. Sprawdź nazwę lub hasło.");
+      break;
+    case WynikSubskrypcji::Limit:
+      wyslij_limit_subskrypcji(gniazdo);
+      break;
+  }
+}
+
+void komenda_wypisz(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string_view nazwa_pokoju = komendy::nastepny_token(&argumenty);
+  if (nazwa_pokoju.empty()) {
+    wyslij_system(gniazdo, "Użycie: /part <pokój>");
+    return;
+  }
+  UchwytPokoju pokoj = znajdz_subskrypcje(sesja, nazwa_pokoju);
+  bool zmieniono_aktywny = false;
+  WynikWypisania wynik =
+      pokoj ? wypisz_z_pokoju(sesja, pokoj, &zmieniono_aktywny) : WynikWypisania::NieCzlonek;
+  if (wynik == WynikWypisania::NieCzlonek) {
+    wyslij_system(gniazdo, "Nie należysz do pokoju: " + std::string(nazwa_pokoju));
+    return;
+  }
+  if (wynik == WynikWypisania::OstatniPokoj) {
+    wyslij_system(gniazdo, "Nie można opuścić Lobby, gdy nie należysz do innego pokoju.");
+    return;
+  }
+  obecnosc.opuszczono_pokoj(pokoj, gniazdo, sesja.nazwa);
+  zapisz_log(sesja.nazwa + " opuścił pokój " + pokoj->nazwa);
+  if (zmieniono_aktywny) {
+    wyslij_przypisanie_pokoju(gniazdo, pokoj_sesji(sesja)->nazwa);
+  }
+  wyslij_system(gniazdo, "Opuszczono pokój " + pokoj->nazwa + ".");
+}
+
+void komenda_powiedz(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string_view nazwa_pokoju = komendy::nastepny_token(&argumenty);
+  std::string_view tresc = komendy::przytnij(argumenty);
+  if (nazwa_pokoju.empty() || tresc.empty()) {
+    wyslij_system(gniazdo, "Użycie: /say <pokój> <wiadomość>");
+    return;
+  }
+  UchwytPokoju pokoj = znajdz_subskrypcje(sesja, nazwa_pokoju);
+  if (!pokoj) {
+    wyslij_system(gniazdo, "Nie należysz do pokoju: " + std::string(nazwa_pokoju));
+    return;
+  }
+  wyslij_do_pokoju(sesja, *pokoj, tresc);
+}
+
+void komenda_subskrypcje(SesjaKlienta& sesja, std::string_view) {
+  UchwytPokoju aktywny = pokoj_sesji(sesja);
+  std::string lista;
+  {
+    blokady::Wylaczna<std::mutex> blokada(sesja.mutex_subskrypcji);
+    for (const UchwytPokoju& pokoj : sesja.subskrypcje) {
+      lista += (lista.empty() ? "" : ", ") + pokoj->nazwa + (pokoj == aktywny ? " (aktywny)" : "");
+    }
+  }
+  wyslij_system(sesja.gniazdo, lista.empty() ? "Nie należysz do żadnego pokoju."
+                                             : "Twoje pokoje: " + lista + ".");
+}
+
+void komenda_usun(SesjaKlienta& sesja, std::string_view argumenty) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  std::string nazwa_pokoju(komendy::nastepny_token(&argumenty));
+  if (nazwa_pokoju.empty()) {
+    wyslij_system(gniazdo, "Użycie: /delete <pokój>");
+    return;
+  }
+  UchwytPokoju pokoj;
+  std::vector<UchwytGniazda> czlonkowie;
+  WynikUsunieciaPokoju wynik = usun_pokoj(nazwa_pokoju, gniazdo, &pokoj, &czlonkowie);
+  if (wynik == WynikUsunieciaPokoju::NieZnaleziono) {
+    wyslij_system(gniazdo, "Nie znaleziono pokoju.");
+    return;
+  }
+  if (wynik == WynikUsunieciaPokoju::Lobby) {
+    wyslij_system(gniazdo, "Lobby nie może zostać usunięte.");
+    return;
+  }
+  if (wynik == WynikUsunieciaPokoju::NieWlasciciel) {
+    wyslij_system(gniazdo, "Tylko właściciel pokoju może go usunąć.");
+    return;
+  }
+  for (UchwytGniazda gniazdo_czlonka : czlonkowie) {
+    std::shared_ptr<Polaczenie> polaczenie = znajdz_polaczenie(gniazdo_czlonka);
+    if (!polaczenie) {
+      continue;
+    }
+    if (!wypisz_z_usunietego(polaczenie->sesja, pokoj)) {
+      wyslij_system(gniazdo_czlonka, "Pokój " + nazwa_pokoju + " został usunięty.");
+      continue;
+    }
+    wyslij_przypisanie_pokoju(gniazdo_czlonka, lobby->nazwa);
+    wyslij_system(gniazdo_czlonka, "Pokój usunięty. Przeniesiono Cię do Lobby.");
+  }
+  katalog_pokoi.rozeslij();
+  zapisz_log(sesja.nazwa + " usunął pokój " + nazwa_pokoju);
+}
+
+void komenda_opusc(SesjaKlienta& sesja, std::string_view) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  UchwytPokoju obecny_pokoj = pokoj_sesji(sesja);
+  if (obecny_pokoj == lobby) {
+    wyslij_system(gniazdo, "Już jesteś w Lobby.");
+    return;
+  }
+  bool zmieniono_aktywny = false;
+  if (obecny_pokoj &&
+      wypisz_z_pokoju(sesja, obecny_pokoj, &zmieniono_aktywny) == WynikWypisania::Wypisano) {
+    obecnosc.opuszczono_pokoj(obecny_pokoj, gniazdo, sesja.nazwa);
+  }
+  if (subskrybuj(sesja, lobby, "") == WynikSubskrypcji::Limit) {
+    wyslij_limit_subskrypcji(gniazdo);
+    return;
+  }
+  wyslij_przypisanie_pokoju(gniazdo, lobby->nazwa);
+  wyslij_system(gniazdo, "Przeniesiono do Lobby.");
+}
+
+using DyspozytorKomend = komendy::Dyspozytor<SesjaKlienta>;
+
+constexpr std::array<DyspozytorKomend::Wpis, 14> kWbudowaneKomendy = {{
+    {"name", komenda_nazwa},
+    {"msg", komenda_prywatna},
+    {"rooms", komenda_pokoje},
+    {"stats", komenda_statystyki},
+    {"locks", komenda_blokady},
+    {"create", komenda_utworz},
+    {"join", komenda_dolacz},
+    {"part", komenda_wypisz},
+    {"say", komenda_powiedz},
+    {"joined", komenda_subskrypcje},
+    {"delete", komenda_usun},
+    {"leave", komenda_opusc},
+    {"proto", komenda_protokol},
+    {"history", komenda_historia},
+}};
+
+DyspozytorKomend dyspozytor_komend(kWbudowaneKomendy);
+
+void obsluz_linie(SesjaKlienta& sesja, std::string_view linia) {
+  if (dyspozytor_komend.wykonaj(sesja, linia)) {
+    return;
+  }
+  wyslij_do_pokoju(sesja, linia);
+}
+
+void obsluz_ramke(SesjaKlienta& sesja, protokol::TypRamki typ, std::string_view ladunek) {
+  if (ladunek.find_first_of("\r\n") != std::string_view::npos) {
+    wyslij_system(sesja.gniazdo, "Ramka nie może zawierać znaków nowej linii.");
+    return;
+  }
+  std::string_view tresc = komendy::przytnij(ladunek);
+  if (tresc.empty()) {
+    return;
+  }
+  switch (typ) {
+    case protokol::TypRamki::Tekst:
+      obsluz_linie(sesja, tresc);
+      break;
+    case protokol::TypRamki::WiadomoscPokoju:
+      wyslij_do_pokoju(sesja, tresc);
+      break;
+    default:
+      break;
+  }
+}
+
+bool przetworz_przychodzace(Polaczenie& polaczenie, const char* dane, size_t rozmiar) {
+  SesjaKlienta& sesja = polaczenie.sesja;
+  metryki_serwera.bajty_przychodzace.dodaj(rozmiar);
+  if (zamykanie.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  if (!sesja.binarny) {
+    WynikRamkowania wynik = polaczenie.wejscie.przyjmij(
+        dane, rozmiar, maks_dlugosc_linii, [&](std::string_view surowa) {
+          std::string_view linia = komendy::przytnij(surowa);
+          if (!linia.empty() && !zamykanie.load(std::memory_order_relaxed)) {
+            metryki_serwera.wiadomosci_przychodzace.dodaj();
+            if (w_limicie_polaczenia(sesja)) {
+              obsluz_linie(sesja, linia);
+            }
+          }
+          return !sesja.binarny;
+        });
+    if (wynik.odrzucono) {
+      wyslij_system(sesja.gniazdo, "Odrzucono linię dłuższą niż " +
+                                       std::to_string(maks_dlugosc_linii) + " bajtów.");
+    }
+    if (!sesja.binarny) {
+      return true;
+    }
+    dane += wynik.zuzyte;
+    rozmiar -= wynik.zuzyte;
+  }
+  return polaczenie.ramki.przyjmij(
+      dane, rozmiar, maks_dlugosc_linii + kZapasNaglowkaRamki,
+      [&](protokol::TypRamki typ, std::string_view ladunek) {
+        if (!zamykanie.load(std::memory_order_relaxed)) {
+          metryki_serwera.wiadomosci_przychodzace.dodaj();
+          if (w_limicie_polaczenia(sesja)) {
+            obsluz_ramke(sesja, typ, ladunek);
+          }
+        }
+      });
+}
+
+void zakoncz_sesje(SesjaKlienta& sesja) {
+  UchwytGniazda gniazdo = sesja.gniazdo;
+  klienci.zmien(gniazdo, [&](auto& mapa) { mapa.erase(gniazdo); });
+  zwolnij_nazwe(sesja.nazwa, gniazdo);
+  std::vector<UchwytPokoju> subskrypcje = wypisz_ze_wszystkich(sesja);
+  bool ogloszenia = !zamykanie.load(std::memory_order_relaxed);
+  if (ogloszenia) {
+    for (const UchwytPokoju& pokoj : subskrypcje) {
+      obecnosc.opuszczono_pokoj(pokoj, gniazdo, sesja.nazwa);
+    }
+  }
+  if (ogloszenia) {
+    obecnosc.opuszczono_czat(gniazdo, sesja.nazwa);
+  }
+  zapisz_log(sesja.nazwa + " opuścił czat.");
+}
+
+std::shared_ptr<Polaczenie> zarejestruj_polaczenie(UchwytGniazda gniazdo,
+                                                   GotoweDoWysylki* gotowe = nullptr) {
+  auto polaczenie = std::make_shared<Polaczenie>();
+  polaczenie->sesja.gniazdo = gniazdo;
+  polaczenie->gotowe = gotowe;
+  polaczenia.zmien(gniazdo, [&](auto& mapa) { mapa[gniazdo] = polaczenie; });
+  metryki_serwera.polaczenia_otwarte.dodaj();
+  return polaczenie;
+}
+
+std::mutex mutex_watkow_klientow;
+std::condition_variable koniec_watku_klienta;
+size_t watki_klientow = 0;
+
+void zamknij_polaczenie(Polaczenie& polaczenie) {
+  UchwytGniazda gniazdo = polaczenie.sesja.gniazdo;
+  zakoncz_sesje(polaczenie.sesja);
+  std::shared_ptr<Polaczenie> ostatnia_referencja =
+      polaczenia.zmien(gniazdo, [&](auto& mapa) {
+        std::shared_ptr<Polaczenie> wynik;
+        auto iter = mapa.find(gniazdo);
+        if (iter != mapa.end()) {
+          wynik = std::move(iter->second);
+          mapa.erase(iter);
+        }
+        return wynik;
+      });
+  {
+    std::lock_guard<std::mutex> blokada(polaczenie.mutex_wyjscia);
+    odetnij_polaczenie(polaczenie);
+    if (polaczenie.binarny) {
+      polaczenie.binarny = false;
+      liczba_binarnych.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  if (polaczenie.pisarz.joinable()) {
+    polaczenie.pisarz.join();
+  }
+  zamknij_gniazdo(gniazdo);
+  metryki_serwera.polaczenia_zamkniete.dodaj();
+  if (zamykanie.load()) {
+    // W trybie epoll nie ma wątku klienta, więc czekaj_na_rozlaczenie budzi samo zamknięcie.
+    std::lock_guard<std::mutex> blokada(mutex_watkow_klientow);
+    koniec_watku_klienta.notify_all();
+  }
+}
+
+constexpr size_t kRozmiarBuforaOdczytu = 64 * 1024;
+
+void obsluz_klienta(UchwytGniazda gniazdo, int id_klienta) {
+  std::shared_ptr<Polaczenie> polaczenie = zarejestruj_polaczenie(gniazdo);
+  polaczenie->pisarz = std::thread(petla_pisarza, polaczenie.get());
+  rozpocznij_sesje(polaczenie->sesja, id_klienta);
+
+  std::vector<char> bufor(kRozmiarBuforaOdczytu);
+  while (true) {
+    RozmiarGniazda odebrano =
+        recv(gniazdo, bufor.data(), static_cast<int>(bufor.size()), 0);
+    if (odebrano <= 0 ||
+        !przetworz_przychodzace(*polaczenie, bufor.data(), static_cast<size_t>(odebrano))) {
+      break;
+    }
+  }
+
+  zamknij_polaczenie(*polaczenie);
+}
+
+#ifdef __linux__
+class Reaktor {
+ public:
+  ~Reaktor() {
+    zatrzymaj();
+    if (epoll_ >= 0) {
+      close(epoll_);
+    }
+    if (budzik_ >= 0) {
+      close(budzik_);
+    }
+  }
+
+  bool uruchom() {
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    budzik_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || budzik_ < 0) {
+      return false;
+    }
+    epoll_event zdarzenie{};
+    zdarzenie.events = EPOLLIN;
+    zdarzenie.data.ptr = nullptr;
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, budzik_, &zdarzenie) != 0) {
+      return false;
+    }
+    gotowe_.budzik = budzik_;
+    watek_ = std::thread(&Reaktor::petla, this);
+    gotowe_.watek = watek_.get_id();
+    return true;
+  }
+
+  void zatrzymaj() {
+    if (!watek_.joinable()) {
+      return;
+    }
+    koniec_.store(true);
+    uint64_t jeden = 1;
+    (void)!write(budzik_, &jeden, sizeof(jeden));
+    watek_.join();
+  }
+
+  bool dodaj(const std::shared_ptr<Polaczenie>& polaczenie) {
+    return obserwuj(EPOLL_CTL_ADD, *polaczenie);
+  }
+
+  GotoweDoWysylki* gotowe() { return &gotowe_; }
+
+ private:
+  void petla() {
+    std::vector<epoll_event> zdarzenia(kZdarzeniaNaObrot);
+    std::vector<char> bufor(kRozmiarBuforaOdczytu);
+    std::vector<std::shared_ptr<Polaczenie>> do_wysylki;
+    while (!koniec_.load()) {
+      int gotowe = epoll_wait(epoll_, zdarzenia.data(), static_cast<int>(zdarzenia.size()),
+                              kLimitCzekaniaMs);
+      if (gotowe < 0) {
+        if (errno == EINTR) {
+          continue;
         }
-        if (obecny_pokoj.empty() || obecny_pokoj == "Lobby") {
-          wyslij_system(gniazdo, "Już jesteś w Lobby.");
+        std::cerr << "Błąd epoll_wait: " << tekst_bledu_gniazda() << "\n";
+        break;
+      }
+      for (int i = 0; i < gotowe; ++i) {
+        auto* polaczenie = static_cast<Polaczenie*>(zdarzenia[i].data.ptr);
+        if (!polaczenie) {
+          uint64_t licznik;
+          (void)!read(budzik_, &licznik, sizeof(licznik));
           continue;
         }
-        opusc_pokoj(gniazdo, obecny_pokoj);
-        rozglos_wiadomosc_pokoju(
-            obecny_pokoj, "[system] " + nazwa_klienta + " opuścił pokój.\n", gniazdo);
-        dolacz_do_pokoju(gniazdo, "Lobby", "");
-        {
-          std::lock_guard<std::mutex> blokada(mutex_klientow);
-          klienci[gniazdo].pokoj = "Lobby";
+        uint32_t flagi = zdarzenia[i].events;
+        bool zamknij = (flagi & (EPOLLERR | EPOLLHUP)) != 0;
+        if (!zamknij && (flagi & (EPOLLIN | EPOLLRDHUP))) {
+          zamknij = !czytaj(*polaczenie, bufor);
+        }
+        if (!zamknij && (flagi & EPOLLOUT)) {
+          std::lock_guard<std::mutex> blokada(polaczenie->mutex_wyjscia);
+          zamknij = !polaczenie->zamkniete && !oproznij_wychodzace(*polaczenie);
+        }
+        if (zamknij) {
+          epoll_ctl(epoll_, EPOLL_CTL_DEL, polaczenie->sesja.gniazdo, nullptr);
+          zamknij_polaczenie(*polaczenie);
         }
-        wyslij_przypisanie_pokoju(gniazdo, "Lobby");
-        wyslij_system(gniazdo, "Przeniesiono do Lobby.");
-        continue;
       }
+      wyslij_gotowe(do_wysylki);
+    }
+  }
 
-      std::string obecny_pokoj;
-      {
-        std::lock_guard<std::mutex> blokada(mutex_klientow);
-        obecny_pokoj = klienci[gniazdo].pokoj;
+  void wyslij_gotowe(std::vector<std::shared_ptr<Polaczenie>>& do_wysylki) {
+    {
+      blokady::Wylaczna<std::mutex> blokada(gotowe_.mutex);
+      do_wysylki.swap(gotowe_.polaczenia);
+    }
+    for (const std::shared_ptr<Polaczenie>& polaczenie : do_wysylki) {
+      std::lock_guard<std::mutex> blokada(polaczenie->mutex_wyjscia);
+      polaczenie->zaplanowane = false;
+      if (!polaczenie->zamkniete && !oproznij_wychodzace(*polaczenie)) {
+        odetnij_polaczenie(*polaczenie);
       }
+    }
+    do_wysylki.clear();
+  }
+
+  bool obserwuj(int operacja, Polaczenie& polaczenie) {
+    epoll_event zdarzenie{};
+    zdarzenie.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    zdarzenie.data.ptr = &polaczenie;
+    return epoll_ctl(epoll_, operacja, polaczenie.sesja.gniazdo, &zdarzenie) == 0;
+  }
 
-      if (obecny_pokoj.empty()) {
-        wyslij_system(gniazdo, "Dołącz do pokoju zanim zaczniesz pisać.");
+  // Czyta najwyżej kOdczytowNaObrot buforów, żeby jeden zalewający nadawca nie
+  // odsuwał w nieskończoność wysyłki na końcu obrotu. Jeśli w gnieździe zostały
+  // dane, EPOLL_CTL_MOD uzbraja je ponownie i następny epoll_wait zwróci je od razu.
+  bool czytaj(Polaczenie& polaczenie, std::vector<char>& bufor) {
+    for (int odczyty = 0; odczyty < kOdczytowNaObrot;) {
+      ssize_t odebrano = recv(polaczenie.sesja.gniazdo, bufor.data(), bufor.size(), 0);
+      if (odebrano > 0) {
+        if (!przetworz_przychodzace(polaczenie, bufor.data(), static_cast<size_t>(odebrano))) {
+          return false;
+        }
+        ++odczyty;
         continue;
       }
-
-      std::string sformatowana =
-          "[" + obecny_pokoj + "] " + nazwa_klienta + ": " + linia + "\n";
-      rozglos_wiadomosc_pokoju(obecny_pokoj, sformatowana);
-      zapisz_log("[" + obecny_pokoj + "] " + nazwa_klienta + ": " + linia);
+      if (odebrano < 0 && errno == EINTR) {
+        continue;
+      }
+      if (odebrano < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      }
+      return false;
     }
+    return obserwuj(EPOLL_CTL_MOD, polaczenie);
   }
 
-  std::string obecny_pokoj;
-  {
-    std::lock_guard<std::mutex> blokada(mutex_klientow);
-    obecny_pokoj = klienci[gniazdo].pokoj;
-    klienci.erase(gniazdo);
-  }
-  if (!obecny_pokoj.empty()) {
-    opusc_pokoj(gniazdo, obecny_pokoj);
-    rozglos_wiadomosc_pokoju(
-        obecny_pokoj, "[system] " + nazwa_klienta + " opuścił pokój.\n", gniazdo);
+  static constexpr size_t kZdarzeniaNaObrot = 256;
+  static constexpr int kOdczytowNaObrot = 1;
+  static constexpr int kLimitCzekaniaMs = 500;
+
+  int epoll_ = -1;
+  int budzik_ = -1;
+  GotoweDoWysylki gotowe_;
+  std::atomic<bool> koniec_{false};
+  std::thread watek_;
+};
+
+void podnies_limit_deskryptorow() {
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
   }
-  zamknij_gniazdo(gniazdo);
-  rozglos_wiadomosc("[system] " + nazwa_klienta + " opuścił czat.\n");
-  zapisz_log(nazwa_klienta + " opuścił czat.");
 }
 
-void obsluz_sygnal(int) {
-  uruchomione.store(false);
+std::vector<std::unique_ptr<Reaktor>> reaktory;
+#endif
+
+std::atomic<UchwytGniazda> gniazdo_nasluchu{kNieprawidloweGniazdo};
+#ifndef _WIN32
+int budzik_nasluchu[2] = {-1, -1};
+#endif
+
+void zbudz_akceptory() {
+#ifndef _WIN32
+  char bajt = 1;
+  (void)!write(budzik_nasluchu[1], &bajt, 1);
+#endif
 }
-}  // namespace
 
-int main(int liczba_argumentow, char* argumenty[]) {
-  int port = 5555;
-  std::string sciezka_logu = "chat.log";
-  if (liczba_argumentow >= 2) {
-    port = std::stoi(argumenty[1]);
+void obsluz_sygnal(int) {
+  if (!uruchomione.exchange(false)) {
+    std::_Exit(1);
   }
-  if (liczba_argumentow >= 3) {
-    sciezka_logu = argumenty[2];
+#ifdef _WIN32
+  UchwytGniazda gniazdo = gniazdo_nasluchu.exchange(kNieprawidloweGniazdo);
+  if (gniazdo != kNieprawidloweGniazdo) {
+    closesocket(gniazdo);
   }
+#else
+  zbudz_akceptory();
+#endif
+}
 
-  plik_logu.open(sciezka_logu, std::ios::app);
-  if (!plik_logu) {
-    std::cerr << "Nie można otworzyć pliku logu: " << sciezka_logu << "\n";
-    return 1;
-  }
+std::vector<std::shared_ptr<Polaczenie>> wszystkie_polaczenia() {
+  std::vector<std::shared_ptr<Polaczenie>> wynik;
+  polaczenia.dla_kazdego([&](UchwytGniazda, const std::shared_ptr<Polaczenie>& polaczenie) {
+    wynik.push_back(polaczenie);
+  });
+  return wynik;
+}
 
-  std::signal(SIGINT, obsluz_sygnal);
+size_t oproznij_kolejki(std::chrono::steady_clock::time_point termin) {
+  size_t nieoproznione = 0;
+  for (const std::shared_ptr<Polaczenie>& polaczenie : wszystkie_polaczenia()) {
+    std::unique_lock<std::mutex> blokada(polaczenie->mutex_wyjscia);
+    bool oproznione = polaczenie->zmiana_kolejki.wait_until(blokada, termin, [&] {
+      return polaczenie->zamkniete || (polaczenie->kolejka.empty() && !polaczenie->wysylanie);
+    });
+    if (!oproznione) {
+      ++nieoproznione;
+    }
+  }
+  return nieoproznione;
+}
 
-#ifdef _WIN32
-  WSADATA dane_wsa;
-  if (WSAStartup(MAKEWORD(2, 2), &dane_wsa) != 0) {
-    std::cerr << "WSAStartup failed: " << tekst_bledu_gniazda() << "\n";
-    return 1;
+void rozlacz_wszystkich() {
+  for (const std::shared_ptr<Polaczenie>& polaczenie : wszystkie_polaczenia()) {
+    std::lock_guard<std::mutex> blokada(polaczenie->mutex_wyjscia);
+    if (!polaczenie->zamkniete) {
+      odetnij_polaczenie(*polaczenie);
+    }
   }
-#endif
+}
+
+void watek_klienta(UchwytGniazda gniazdo, int id_klienta) {
+  obsluz_klienta(gniazdo, id_klienta);
+  std::lock_guard<std::mutex> blokada(mutex_watkow_klientow);
+  --watki_klientow;
+  koniec_watku_klienta.notify_all();
+}
 
+void uruchom_watek_klienta(UchwytGniazda gniazdo, int id_klienta) {
   {
-    std::lock_guard<std::mutex> blokada(mutex_pokoi);
-    pokoje.emplace("Lobby", InformacjePokoju{"Lobby", "", kNieprawidloweGniazdo, {}});
+    std::lock_guard<std::mutex> blokada(mutex_watkow_klientow);
+    ++watki_klientow;
   }
+  std::thread(watek_klienta, gniazdo, id_klienta).detach();
+}
 
-  UchwytGniazda gniazdo_serwera = socket(AF_INET, SOCK_STREAM, 0);
-  if (gniazdo_serwera == kNieprawidloweGniazdo) {
+bool czekaj_na_rozlaczenie(std::chrono::steady_clock::time_point termin) {
+  std::unique_lock<std::mutex> blokada(mutex_watkow_klientow);
+  return koniec_watku_klienta.wait_until(
+      blokada, termin, [] { return watki_klientow == 0 && aktywne_polaczenia() == 0; });
+}
+
+std::atomic<int> nastepny_id_klienta{1};
+
+UchwytGniazda otworz_nasluch(int port, int kolejka, bool wspoldzielony) {
+  UchwytGniazda gniazdo = socket(AF_INET, SOCK_STREAM, 0);
+  if (gniazdo == kNieprawidloweGniazdo) {
     std::cerr << "Błąd gniazda: " << tekst_bledu_gniazda() << "\n";
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    return 1;
+    return kNieprawidloweGniazdo;
   }
 
   int opcja = 1;
 #ifdef _WIN32
-  setsockopt(gniazdo_serwera,
+  setsockopt(gniazdo,
              SOL_SOCKET,
              SO_REUSEADDR,
              reinterpret_cast<const char*>(&opcja),
              static_cast<int>(sizeof(opcja)));
 #else
-  setsockopt(gniazdo_serwera, SOL_SOCKET, SO_REUSEADDR, &opcja, sizeof(opcja));
+  setsockopt(gniazdo, SOL_SOCKET, SO_REUSEADDR, &opcja, sizeof(opcja));
+  fcntl(gniazdo, F_SETFD, FD_CLOEXEC);
+  fcntl(gniazdo, F_SETFL, fcntl(gniazdo, F_GETFL, 0) | O_NONBLOCK);
+#endif
+#ifdef SO_REUSEPORT
+  if (wspoldzielony && setsockopt(gniazdo, SOL_SOCKET, SO_REUSEPORT, &opcja, sizeof(opcja)) < 0) {
+    std::cerr << "Błąd SO_REUSEPORT: " << tekst_bledu_gniazda() << "\n";
+    zamknij_gniazdo(gniazdo);
+    return kNieprawidloweGniazdo;
+  }
+#else
+  (void)wspoldzielony;
 #endif
 
   sockaddr_in adres{};
@@ -615,53 +3477,673 @@ int main(int liczba_argumentow, char* argumenty[]) {
   adres.sin_addr.s_addr = INADDR_ANY;
   adres.sin_port = htons(static_cast<uint16_t>(port));
 
-  if (bind(gniazdo_serwera, reinterpret_cast<sockaddr*>(&adres), sizeof(adres)) < 0) {
+  if (bind(gniazdo, reinterpret_cast<sockaddr*>(&adres), sizeof(adres)) < 0) {
     std::cerr << "Błąd bind: " << tekst_bledu_gniazda() << "\n";
-    zamknij_gniazdo(gniazdo_serwera);
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    return 1;
+    zamknij_gniazdo(gniazdo);
+    return kNieprawidloweGniazdo;
   }
 
-  if (listen(gniazdo_serwera, 10) < 0) {
+  if (listen(gniazdo, kolejka) < 0) {
     std::cerr << "Błąd listen: " << tekst_bledu_gniazda() << "\n";
-    zamknij_gniazdo(gniazdo_serwera);
-#ifdef _WIN32
-    WSACleanup();
+    zamknij_gniazdo(gniazdo);
+    return kNieprawidloweGniazdo;
+  }
+  return gniazdo;
+}
+
+UchwytGniazda przyjmij_klienta(UchwytGniazda gniazdo_serwera) {
+#ifdef __linux__
+  return accept4(gniazdo_serwera, nullptr, nullptr,
+                 SOCK_CLOEXEC | (tryb_reaktora ? SOCK_NONBLOCK : 0));
+#elif defined(_WIN32)
+  return accept(gniazdo_serwera, nullptr, nullptr);
+#else
+  UchwytGniazda gniazdo = accept(gniazdo_serwera, nullptr, nullptr);
+  if (gniazdo != kNieprawidloweGniazdo) {
+    fcntl(gniazdo, F_SETFD, FD_CLOEXEC);
+    fcntl(gniazdo, F_SETFL, fcntl(gniazdo, F_GETFL, 0) & ~O_NONBLOCK);
+  }
+  return gniazdo;
 #endif
-    return 1;
+}
+
+void obsluz_nowego_klienta(UchwytGniazda gniazdo_klienta) {
+  int id_klienta = nastepny_id_klienta.fetch_add(1);
+  if (ustawienia_scalania.bez_opoznien) {
+    ustaw_opcje_tcp(gniazdo_klienta, TCP_NODELAY, true);
+  }
+#ifdef __linux__
+  if (tryb_reaktora) {
+    Reaktor& reaktor = *reaktory[static_cast<size_t>(id_klienta) % reaktory.size()];
+    std::shared_ptr<Polaczenie> polaczenie =
+        zarejestruj_polaczenie(gniazdo_klienta, reaktor.gotowe());
+    rozpocznij_sesje(polaczenie->sesja, id_klienta);
+    if (!reaktor.dodaj(polaczenie)) {
+      std::cerr << "Błąd epoll_ctl: " << tekst_bledu_gniazda() << "\n";
+      zamknij_polaczenie(*polaczenie);
+    }
+    return;
   }
+#endif
+  uruchom_watek_klienta(gniazdo_klienta, id_klienta);
+}
 
-  std::cout << "Serwer czatu uruchomiony na porcie " << port
-            << ". Plik logu: " << sciezka_logu << "\n";
+constexpr auto kPrzerwaPoBledzieAccept = std::chrono::milliseconds(50);
+constexpr auto kOdstepZgloszenAccept = std::chrono::seconds(1);
 
-  int id_klienta = 1;
-  while (uruchomione.load()) {
-    sockaddr_in adres_klienta{};
-    TypDlugosciGniazda dlugosc_klienta = sizeof(adres_klienta);
-    UchwytGniazda gniazdo_klienta = accept(gniazdo_serwera,
-                                          reinterpret_cast<sockaddr*>(&adres_klienta),
-                                          &dlugosc_klienta);
-    if (gniazdo_klienta == kNieprawidloweGniazdo) {
+bool blad_przejsciowy_accept() {
 #ifdef _WIN32
-      if (WSAGetLastError() == WSAEINTR) {
-        continue;
-      }
+  int kod = WSAGetLastError();
+  return kod == WSAEMFILE || kod == WSAENOBUFS;
+#else
+  return errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM;
+#endif
+}
+
+void zglos_przejsciowy_blad_accept() {
+  static std::mutex mutex_zgloszen;
+  static std::chrono::steady_clock::time_point ostatnie_zgloszenie;
+  static uint64_t pominiete = 0;
+  std::string opis = tekst_bledu_gniazda();
+  std::lock_guard<std::mutex> blokada(mutex_zgloszen);
+  auto teraz = std::chrono::steady_clock::now();
+  if (ostatnie_zgloszenie.time_since_epoch().count() != 0 &&
+      teraz - ostatnie_zgloszenie < kOdstepZgloszenAccept) {
+    ++pominiete;
+    return;
+  }
+  std::cerr << "Błąd accept: " << opis << ", ponawiam";
+  if (pominiete > 0) {
+    std::cerr << " (pominięto " << pominiete << " podobnych zgłoszeń)";
+  }
+  std::cerr << "\n";
+  ostatnie_zgloszenie = teraz;
+  pominiete = 0;
+}
+
+bool odczekaj_po_bledzie_accept() {
+#ifdef _WIN32
+  std::this_thread::sleep_for(kPrzerwaPoBledzieAccept);
+  return uruchomione.load();
 #else
+  pollfd budzik = {budzik_nasluchu[0], POLLIN, 0};
+  int czas = static_cast<int>(kPrzerwaPoBledzieAccept.count());
+  return poll(&budzik, 1, czas) <= 0 && uruchomione.load();
+#endif
+}
+
+void petla_akceptora(UchwytGniazda gniazdo_serwera) {
+  while (uruchomione.load()) {
+#ifndef _WIN32
+    pollfd oczekiwane[2] = {{gniazdo_serwera, POLLIN, 0}, {budzik_nasluchu[0], POLLIN, 0}};
+    if (poll(oczekiwane, 2, -1) < 0) {
       if (errno == EINTR) {
         continue;
       }
+      std::cerr << "Błąd poll: " << std::strerror(errno) << "\n";
+      break;
+    }
+    if (oczekiwane[1].revents != 0) {
+      return;
+    }
+    if ((oczekiwane[0].revents & POLLIN) == 0) {
+      continue;
+    }
+#endif
+    while (true) {
+      UchwytGniazda gniazdo_klienta = przyjmij_klienta(gniazdo_serwera);
+      if (gniazdo_klienta == kNieprawidloweGniazdo) {
+        if (!uruchomione.load()) {
+          return;
+        }
+#ifdef _WIN32
+        if (WSAGetLastError() == WSAEINTR) {
+          break;
+        }
+#else
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
 #endif
-      std::cerr << "Błąd accept: " << tekst_bledu_gniazda() << "\n";
+        if (blad_przejsciowy_accept()) {
+          zglos_przejsciowy_blad_accept();
+          if (!odczekaj_po_bledzie_accept()) {
+            return;
+          }
+          break;
+        }
+        std::cerr << "Błąd accept: " << tekst_bledu_gniazda() << "\n";
+        uruchomione.store(false);
+        zbudz_akceptory();
+        return;
+      }
+      obsluz_nowego_klienta(gniazdo_klienta);
+#ifdef _WIN32
       break;
+#endif
+    }
+  }
+  uruchomione.store(false);
+  zbudz_akceptory();
+}
+
+#ifdef SIGHUP
+void obsluz_sighup(int) {
+  potok_logu.popros_o_ponowne_otwarcie();
+}
+#endif
+
+constexpr size_t kBajtyHistoriiNaWiadomosc = 256;
+
+struct KonfiguracjaSerwera {
+  int port = 5555;
+  std::string sciezka_logu = "chat.log";
+  bool tryb_reaktora = false;
+  int liczba_reaktorow = 0;
+  UstawieniaKolejek kolejki;
+  UstawieniaLogu log;
+  PrecyzjaZnacznika precyzja_znacznikow = PrecyzjaZnacznika::Sekundy;
+  size_t maks_dlugosc_linii = 8192;
+  std::chrono::milliseconds okno_zmian_pokoi{0};
+  UstawieniaHistorii historia;
+  bool podano_bajty_historii = false;
+  std::string katalog_magazynu;
+  size_t rozmiar_segmentu = 64 << 20;
+  bool log_tekstowy = true;
+  int port_metryk = 0;
+  bool profilowanie_blokad = false;
+  std::chrono::seconds raport_blokad_co{0};
+  std::chrono::milliseconds limit_zamykania{1000};
+  int kolejka_nasluchu = SOMAXCONN;
+  std::chrono::milliseconds okno_obecnosci{100};
+  UstawieniaLimitow limity;
+  UstawieniaScalania scalanie;
+  bool obecnosc_globalna = true;
+  int liczba_akceptorow = 1;
+};
+
+bool wartosc_opcji(const std::string& argument, const std::string& nazwa, std::string* wartosc) {
+  if (argument.rfind(nazwa + "=", 0) != 0) {
+    return false;
+  }
+  *wartosc = argument.substr(nazwa.size() + 1);
+  return true;
+}
+
+bool odczytaj_liczbe(const std::string& tekst, long long minimum, long long* wynik) {
+  if (tekst.empty()) {
+    return false;
+  }
+  char* koniec = nullptr;
+  errno = 0;
+  long long wartosc = std::strtoll(tekst.c_str(), &koniec, 10);
+  if (errno != 0 || *koniec != '\0' || wartosc < minimum) {
+    return false;
+  }
+  *wynik = wartosc;
+  return true;
+}
+
+bool parsuj_argumenty(int liczba_argumentow,
+                      char* argumenty[],
+                      KonfiguracjaSerwera* konfiguracja) {
+  int pozycyjne = 0;
+  for (int i = 1; i < liczba_argumentow; ++i) {
+    std::string argument = argumenty[i];
+    std::string wartosc;
+    long long liczba = 0;
+    if (argument.rfind("--", 0) != 0) {
+      if (pozycyjne == 0) {
+        if (!odczytaj_liczbe(argument, 1, &liczba) || liczba > 65535) {
+          std::cerr << "Nieprawidłowy port: " << argument << "\n";
+          return false;
+        }
+        konfiguracja->port = static_cast<int>(liczba);
+      } else if (pozycyjne == 1) {
+        konfiguracja->sciezka_logu = argument;
+      } else {
+        std::cerr << "Nadmiarowy argument: " << argument << "\n";
+        return false;
+      }
+      ++pozycyjne;
+    } else if (argument == "--epoll") {
+      konfiguracja->tryb_reaktora = true;
+    } else if (wartosc_opcji(argument, "--reactors", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba) || liczba > 1024) {
+        std::cerr << "Nieprawidłowa liczba reaktorów: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->tryb_reaktora = true;
+      konfiguracja->liczba_reaktorow = static_cast<int>(liczba);
+    } else if (wartosc_opcji(argument, "--queue-limit", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba)) {
+        std::cerr << "Nieprawidłowy limit kolejki: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->kolejki.limit_bajtow = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--slow-policy", &wartosc)) {
+      if (wartosc == "drop-oldest") {
+        konfiguracja->kolejki.polityka = PolitykaWolnegoOdbiorcy::UsunNajstarsze;
+      } else if (wartosc == "disconnect") {
+        konfiguracja->kolejki.polityka = PolitykaWolnegoOdbiorcy::Rozlacz;
+      } else if (wartosc == "backpressure") {
+        konfiguracja->kolejki.polityka = PolitykaWolnegoOdbiorcy::Przeciwcisnienie;
+      } else {
+        std::cerr << "Nieznana polityka wolnego odbiorcy: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--backpressure-timeout-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowy limit oczekiwania: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->kolejki.limit_oczekiwania = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--log-flush-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowy interwał flush logu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->log.co_ile_flush = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--log-flush-records", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowa liczba rekordów flush logu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->log.flush_co_rekordow = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--log-time-precision", &wartosc)) {
+      if (wartosc == "s") {
+        konfiguracja->precyzja_znacznikow = PrecyzjaZnacznika::Sekundy;
+      } else if (wartosc == "ms") {
+        konfiguracja->precyzja_znacznikow = PrecyzjaZnacznika::Milisekundy;
+      } else if (wartosc == "us") {
+        konfiguracja->precyzja_znacznikow = PrecyzjaZnacznika::Mikrosekundy;
+      } else {
+        std::cerr << "Nieznana precyzja znaczników czasu: " << wartosc << "\n";
+        return false;
+      }
+    } else if (argument == "--log-fsync") {
+      konfiguracja->log.fsync_przy_zamknieciu = true;
+    } else if (wartosc_opcji(argument, "--log-queue-limit", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba)) {
+        std::cerr << "Nieprawidłowy limit kolejki logu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->log.limit_kolejki = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--log-rotate-mb", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba) || liczba > (1 << 20)) {
+        std::cerr << "Nieprawidłowy rozmiar rotacji logu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->log.rotacja_co_bajtow = static_cast<size_t>(liczba) << 20;
+    } else if (wartosc_opcji(argument, "--log-rotate-min", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowy interwał rotacji logu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->log.rotacja_co = std::chrono::minutes(liczba);
+    } else if (argument == "--log-compress") {
+      konfiguracja->log.kompresja = true;
+    } else if (wartosc_opcji(argument, "--lock-profile", &wartosc)) {
+      if (!blokady::kProfilowanieWkompilowane) {
+        std::cerr << "Profilowanie blokad nie zostało wkompilowane (CHATAPP_PROFILE_LOCKS).\n";
+        return false;
+      }
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowy okres raportu blokad: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->profilowanie_blokad = true;
+      konfiguracja->raport_blokad_co = std::chrono::seconds(liczba);
+    } else if (wartosc_opcji(argument, "--shutdown-timeout-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowy limit czasu zamykania: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->limit_zamykania = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--presence-window-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowe okno zdarzeń obecności: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->okno_obecnosci = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--coalesce-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba) || liczba > 1000) {
+        std::cerr << "Nieprawidłowe okno scalania wysyłki: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->scalanie.okno = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--coalesce-bytes", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba)) {
+        std::cerr << "Nieprawidłowy próg scalania wysyłki: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->scalanie.prog_bajtow = static_cast<size_t>(liczba);
+    } else if (argument == "--tcp-nodelay") {
+      konfiguracja->scalanie.bez_opoznien = true;
+    } else if (argument == "--tcp-cork") {
+      konfiguracja->scalanie.cork = true;
+    } else if (argument == "--no-presence") {
+      konfiguracja->obecnosc_globalna = false;
+    } else if (wartosc_opcji(argument, "--rate-limit", &wartosc)) {
+      if (!limity::parsuj_limit(wartosc, &konfiguracja->limity.polaczenie)) {
+        std::cerr << "Nieprawidłowy limit połączenia: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--room-rate-limit", &wartosc)) {
+      if (!limity::parsuj_limit(wartosc, &konfiguracja->limity.pokoj)) {
+        std::cerr << "Nieprawidłowy limit pokoju: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--private-rate-limit", &wartosc)) {
+      if (!limity::parsuj_limit(wartosc, &konfiguracja->limity.prywatne)) {
+        std::cerr << "Nieprawidłowy limit wiadomości prywatnych: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--listen-backlog", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba) || liczba > 1000000) {
+        std::cerr << "Nieprawidłowa długość kolejki nasłuchu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->kolejka_nasluchu = static_cast<int>(liczba);
+    } else if (wartosc_opcji(argument, "--acceptors", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba) || liczba > 64) {
+        std::cerr << "Nieprawidłowa liczba akceptorów: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->liczba_akceptorow = static_cast<int>(liczba);
+    } else if (wartosc_opcji(argument, "--metrics-port", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba) || liczba > 65535) {
+        std::cerr << "Nieprawidłowy port metryk: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->port_metryk = static_cast<int>(liczba);
+    } else if (wartosc_opcji(argument, "--room-updates-ms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowe okno zmian listy pokoi: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->okno_zmian_pokoi = std::chrono::milliseconds(liczba);
+    } else if (wartosc_opcji(argument, "--max-line", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba)) {
+        std::cerr << "Nieprawidłowa maksymalna długość linii: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->maks_dlugosc_linii = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--history", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba) || liczba > 1000000) {
+        std::cerr << "Nieprawidłowa długość historii pokoju: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->historia.wiadomosci = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--history-bytes", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba)) {
+        std::cerr << "Nieprawidłowy rozmiar historii pokoju: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->historia.bajty = static_cast<size_t>(liczba);
+      konfiguracja->podano_bajty_historii = true;
+    } else if (wartosc_opcji(argument, "--history-replay", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &liczba)) {
+        std::cerr << "Nieprawidłowa liczba odtwarzanych wiadomości: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->historia.odtwarzane = static_cast<size_t>(liczba);
+    } else if (wartosc_opcji(argument, "--store", &wartosc)) {
+      if (wartosc.empty()) {
+        std::cerr << "Pusta ścieżka magazynu wiadomości.\n";
+        return false;
+      }
+      konfiguracja->katalog_magazynu = wartosc;
+    } else if (wartosc_opcji(argument, "--store-segment-mb", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &liczba) || liczba > 4095) {
+        std::cerr << "Nieprawidłowy rozmiar segmentu magazynu: " << wartosc << "\n";
+        return false;
+      }
+      konfiguracja->rozmiar_segmentu = static_cast<size_t>(liczba) << 20;
+    } else if (argument == "--no-text-log") {
+      konfiguracja->log_tekstowy = false;
+    } else {
+      std::cerr << "Nieznana opcja: " << argument << "\n";
+      return false;
+    }
+  }
+#ifndef __linux__
+  if (konfiguracja->tryb_reaktora) {
+    std::cerr << "Tryb --epoll jest dostępny tylko na Linuksie.\n";
+    return false;
+  }
+#endif
+  if (konfiguracja->tryb_reaktora &&
+      konfiguracja->kolejki.polityka == PolitykaWolnegoOdbiorcy::Przeciwcisnienie) {
+    std::cerr << "--slow-policy=backpressure wstrzymuje wątek nadawcy i nie działa z --epoll; "
+                 "użyj drop-oldest albo disconnect.\n";
+    return false;
+  }
+#ifndef TCP_CORK
+  if (konfiguracja->scalanie.cork) {
+    std::cerr << "--tcp-cork wymaga TCP_CORK, niedostępnego na tej platformie.\n";
+    return false;
+  }
+#endif
+#ifndef SO_REUSEPORT
+  if (konfiguracja->liczba_akceptorow > 1) {
+    std::cerr << "--acceptors wymaga SO_REUSEPORT, niedostępnego na tej platformie.\n";
+    return false;
+  }
+#endif
+  if (!konfiguracja->log_tekstowy && konfiguracja->katalog_magazynu.empty()) {
+    std::cerr << "--no-text-log wymaga --store.\n";
+    return false;
+  }
+  if (!konfiguracja->podano_bajty_historii) {
+    konfiguracja->historia.bajty = konfiguracja->historia.wiadomosci * kBajtyHistoriiNaWiadomosc;
+  }
+  if (konfiguracja->tryb_reaktora && konfiguracja->liczba_reaktorow == 0) {
+    unsigned int rdzenie = std::thread::hardware_concurrency();
+    konfiguracja->liczba_reaktorow = rdzenie == 0 ? 1 : static_cast<int>(std::min(rdzenie, 8u));
+  }
+  return true;
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  KonfiguracjaSerwera konfiguracja;
+  if (!parsuj_argumenty(liczba_argumentow, argumenty, &konfiguracja)) {
+    std::cerr << "Użycie: " << argumenty[0]
+              << " [port] [plik_logu] [--epoll] [--reactors=N] [--queue-limit=BAJTY]"
+                 " [--slow-policy=drop-oldest|disconnect|backpressure]"
+                 " [--backpressure-timeout-ms=N] [--log-flush-ms=N] [--log-flush-records=N]"
+                 " [--log-fsync] [--log-queue-limit=N] [--log-time-precision=s|ms|us]"
+                 " [--log-rotate-mb=N] [--log-rotate-min=N] [--log-compress]"
+                 " [--max-line=BAJTY] [--room-updates-ms=N] [--history=N]"
+                 " [--history-bytes=BAJTY] [--history-replay=N] [--store=KATALOG]"
+                 " [--store-segment-mb=N] [--no-text-log] [--metrics-port=N]"
+                 " [--lock-profile=SEKUNDY] [--shutdown-timeout-ms=N]"
+                 " [--listen-backlog=N] [--acceptors=N] [--presence-window-ms=N]"
+                 " [--no-presence] [--rate-limit=N[:SERIA]] [--room-rate-limit=N[:SERIA]]"
+                 " [--private-rate-limit=N[:SERIA]] [--coalesce-ms=N] [--coalesce-bytes=BAJTY]"
+                 " [--tcp-nodelay] [--tcp-cork]\n";
+    return 1;
+  }
+  const int port = konfiguracja.port;
+  const std::string& sciezka_logu = konfiguracja.sciezka_logu;
+  tryb_reaktora = konfiguracja.tryb_reaktora;
+  ustawienia_kolejek = konfiguracja.kolejki;
+  maks_dlugosc_linii = konfiguracja.maks_dlugosc_linii;
+  ustawienia_historii = konfiguracja.historia;
+  ustawienia_limitow = konfiguracja.limity;
+  ustawienia_scalania = konfiguracja.scalanie;
+  zegar_znacznikow.ustaw_precyzje(konfiguracja.precyzja_znacznikow);
+
+  if (!konfiguracja.katalog_magazynu.empty()) {
+    if (!magazyn_wiadomosci.otworz(konfiguracja.katalog_magazynu, konfiguracja.rozmiar_segmentu,
+                                   false)) {
+      std::cerr << "Nie można otworzyć magazynu wiadomości: " << konfiguracja.katalog_magazynu
+                << "\n";
+      return 1;
+    }
+    const std::vector<std::string>& pokoje_magazynu = magazyn_wiadomosci.nazwy_pokoi();
+    for (size_t id = 1; id < pokoje_magazynu.size(); ++id) {
+      slownik_pokoi.przywroc(static_cast<uint32_t>(id), pokoje_magazynu[id]);
+    }
+    const std::vector<std::string>& uzytkownicy_magazynu = magazyn_wiadomosci.nazwy_uzytkownikow();
+    for (size_t id = 1; id < uzytkownicy_magazynu.size(); ++id) {
+      slownik_uzytkownikow.przywroc(static_cast<uint32_t>(id), uzytkownicy_magazynu[id]);
+    }
+  }
+  if (!potok_logu.otworz(konfiguracja.log_tekstowy ? sciezka_logu : std::string(),
+                         konfiguracja.log,
+                         magazyn_wiadomosci.otwarty() ? &magazyn_wiadomosci : nullptr)) {
+    std::cerr << "Nie można otworzyć pliku logu: " << sciezka_logu << "\n";
+    return 1;
+  }
+
+#ifndef _WIN32
+  if (pipe(budzik_nasluchu) != 0) {
+    std::cerr << "Błąd pipe: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  for (int koniec : budzik_nasluchu) {
+    fcntl(koniec, F_SETFD, FD_CLOEXEC);
+    fcntl(koniec, F_SETFL, fcntl(koniec, F_GETFL, 0) | O_NONBLOCK);
+  }
+#endif
+  std::signal(SIGINT, obsluz_sygnal);
+  std::signal(SIGTERM, obsluz_sygnal);
+#ifdef SIGHUP
+  std::signal(SIGHUP, obsluz_sighup);
+#endif
+#ifndef _WIN32
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+#ifdef _WIN32
+  WSADATA dane_wsa;
+  if (WSAStartup(MAKEWORD(2, 2), &dane_wsa) != 0) {
+    std::cerr << "WSAStartup failed: " << tekst_bledu_gniazda() << "\n";
+    return 1;
+  }
+#endif
+
+  lobby = utworz_pokoj("Lobby", "", kNieprawidloweGniazdo, 0);
+  katalog_pokoi.dodaj_staly(lobby->nazwa);
+  katalog_pokoi.uruchom(konfiguracja.okno_zmian_pokoi);
+  obecnosc.uruchom(konfiguracja.okno_obecnosci, konfiguracja.obecnosc_globalna);
+#ifdef __linux__
+  if (tryb_reaktora && ustawienia_scalania.okno.count() > 0) {
+    scalacz.uruchom();
+  }
+#endif
+  blokady::flaga_profilowania().store(konfiguracja.profilowanie_blokad);
+  if (konfiguracja.raport_blokad_co.count() > 0) {
+    raport_blokad.uruchom(konfiguracja.raport_blokad_co);
+  }
+  if (konfiguracja.port_metryk != 0 && !serwer_metryk.uruchom(konfiguracja.port_metryk)) {
+    std::cerr << "Nie można uruchomić serwera metryk na porcie " << konfiguracja.port_metryk
+              << ": " << tekst_bledu_gniazda() << "\n";
+    return 1;
+  }
+
+  std::vector<UchwytGniazda> gniazda_nasluchu;
+  for (int i = 0; i < konfiguracja.liczba_akceptorow; ++i) {
+    UchwytGniazda gniazdo = otworz_nasluch(port, konfiguracja.kolejka_nasluchu,
+                                           konfiguracja.liczba_akceptorow > 1);
+    if (gniazdo == kNieprawidloweGniazdo) {
+      for (UchwytGniazda otwarte : gniazda_nasluchu) {
+        zamknij_gniazdo(otwarte);
+      }
+#ifdef _WIN32
+      WSACleanup();
+#endif
+      return 1;
+    }
+    gniazda_nasluchu.push_back(gniazdo);
+  }
+
+#ifdef __linux__
+  if (tryb_reaktora) {
+    podnies_limit_deskryptorow();
+    for (int i = 0; i < konfiguracja.liczba_reaktorow; ++i) {
+      reaktory.push_back(std::make_unique<Reaktor>());
+      if (!reaktory.back()->uruchom()) {
+        std::cerr << "Błąd epoll_create1: " << tekst_bledu_gniazda() << "\n";
+        uruchomione.store(false);
+        return 1;
+      }
     }
+  }
+#endif
+
+  std::cout << "Serwer czatu uruchomiony na porcie " << port
+            << ". Plik logu: " << (konfiguracja.log_tekstowy ? sciezka_logu : "brak");
+  if (magazyn_wiadomosci.otwarty()) {
+    std::cout << ". Magazyn: " << konfiguracja.katalog_magazynu;
+  }
+  if (tryb_reaktora) {
+    std::cout << ". Tryb epoll, reaktory: " << konfiguracja.liczba_reaktorow;
+  }
+  if (konfiguracja.liczba_akceptorow > 1) {
+    std::cout << ". Akceptory: " << konfiguracja.liczba_akceptorow;
+  }
+  if (konfiguracja.port_metryk != 0) {
+    std::cout << ". Metryki: 127.0.0.1:" << konfiguracja.port_metryk;
+  }
+  std::cout << "\n";
 
-    std::thread(obsluz_klienta, gniazdo_klienta, id_klienta++).detach();
+  gniazdo_nasluchu.store(gniazda_nasluchu.front());
+  std::vector<std::thread> akceptory;
+  for (size_t i = 1; i < gniazda_nasluchu.size(); ++i) {
+    akceptory.emplace_back(petla_akceptora, gniazda_nasluchu[i]);
+  }
+  petla_akceptora(gniazda_nasluchu.front());
+  for (std::thread& akceptor : akceptory) {
+    akceptor.join();
   }
 
-  zamknij_gniazdo(gniazdo_serwera);
+  auto poczatek_zamykania = std::chrono::steady_clock::now();
+  uruchomione.store(false);
+  if (gniazdo_nasluchu.exchange(kNieprawidloweGniazdo) == kNieprawidloweGniazdo) {
+    gniazda_nasluchu.erase(gniazda_nasluchu.begin());
+  }
+  for (UchwytGniazda gniazdo : gniazda_nasluchu) {
+    zamknij_gniazdo(gniazdo);
+  }
+  zamykanie.store(true);
+  obecnosc.zatrzymaj();
+  size_t zamykane_polaczenia = aktywne_polaczenia();
+  rozglos_wiadomosc("[system] Serwer jest zamykany.\n");
+  size_t niedostarczone =
+      oproznij_kolejki(poczatek_zamykania + konfiguracja.limit_zamykania);
+  rozlacz_wszystkich();
+  bool rozlaczono =
+      czekaj_na_rozlaczenie(std::chrono::steady_clock::now() + konfiguracja.limit_zamykania);
+#ifdef __linux__
+  scalacz.zatrzymaj();
+  reaktory.clear();
+#endif
+  serwer_metryk.zatrzymaj();
+  raport_blokad.zatrzymaj();
+  if (konfiguracja.profilowanie_blokad) {
+    wypisz_raport_blokad();
+  }
+  katalog_pokoi.zatrzymaj();
   zapisz_log("Zamykanie serwera.");
+  potok_logu.zatrzymaj();
+  magazyn_wiadomosci.zamknij();
+  std::cout << "Serwer zamknięty w "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - poczatek_zamykania)
+                   .count()
+            << " ms (połączenia: " << zamykane_polaczenia
+            << ", niedostarczone kolejki: " << niedostarczone << ").\n";
+  if (!rozlaczono) {
+    std::cerr << "Nie wszystkie wątki klientów zakończyły się; kończę proces bez sprzątania.\n";
+    std::cout.flush();
+    std::_Exit(0);
+  }
 #ifdef _WIN32
   WSACleanup();
 #endif
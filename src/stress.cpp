@@ -0,0 +1,815 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+using UchwytGniazda =
+#ifdef _WIN32
+    SOCKET;
+#else
+    int;
+#endif
+
+constexpr UchwytGniazda kNieprawidloweGniazdo =
+#ifdef _WIN32
+    INVALID_SOCKET;
+#else
+    -1;
+#endif
+
+#ifdef _WIN32
+constexpr int kFlagiWysylania = 0;
+#else
+constexpr int kFlagiWysylania = MSG_NOSIGNAL;
+#endif
+
+using Zegar = std::chrono::steady_clock;
+
+constexpr std::string_view kZnacznik = "STRESS ";
+
+enum class Faza : int {
+  Laczenie,
+  Dolaczanie,
+  Pomiar,
+  Oproznianie,
+  Koniec,
+};
+
+struct UstawieniaTestu {
+  std::string host = "127.0.0.1";
+  int port = 5555;
+  int watki = 10;
+  int opoznienie_ms = 10;
+  int czas_s = 0;
+  bool synchronicznie = false;
+  int polaczenia = 0;
+  int pokoje = 1;
+  int procent_prywatnych = 0;
+  int rozmiar = 32;
+  int rundy_burzy = 0;
+};
+
+class HistogramOpoznien {
+ public:
+  void dodaj(uint64_t mikrosekundy) {
+    ++kubelki_[indeks(mikrosekundy)];
+    ++liczba_;
+    maksimum_ = std::max(maksimum_, mikrosekundy);
+  }
+
+  void scal(const HistogramOpoznien& inny) {
+    for (size_t i = 0; i < kubelki_.size(); ++i) {
+      kubelki_[i] += inny.kubelki_[i];
+    }
+    liczba_ += inny.liczba_;
+    maksimum_ = std::max(maksimum_, inny.maksimum_);
+  }
+
+  uint64_t percentyl(double procent) const {
+    if (liczba_ == 0) {
+      return 0;
+    }
+    uint64_t cel = static_cast<uint64_t>(static_cast<double>(liczba_) * procent / 100.0);
+    cel = std::min(std::max<uint64_t>(cel, 1), liczba_);
+    uint64_t suma = 0;
+    for (size_t i = 0; i < kubelki_.size(); ++i) {
+      suma += kubelki_[i];
+      if (suma >= cel) {
+        return std::min(dolna_granica(i), maksimum_);
+      }
+    }
+    return maksimum_;
+  }
+
+  uint64_t liczba() const { return liczba_; }
+  uint64_t maksimum() const { return maksimum_; }
+
+ private:
+  static constexpr int kBityMantysy = 5;
+  static constexpr uint64_t kLiniowe = 1u << (kBityMantysy + 1);
+  static constexpr int kMaksWykladnik = 40;
+  static constexpr size_t kLiczbaKubelkow =
+      kLiniowe + (kMaksWykladnik - kBityMantysy - 1) * (size_t{1} << kBityMantysy);
+
+  static int wykladnik(uint64_t wartosc) {
+    int wynik = 0;
+    while (wartosc >>= 1) {
+      ++wynik;
+    }
+    return wynik;
+  }
+
+  static size_t indeks(uint64_t wartosc) {
+    if (wartosc < kLiniowe) {
+      return static_cast<size_t>(wartosc);
+    }
+    int wykl = std::min(wykladnik(wartosc), kMaksWykladnik - 1);
+    uint64_t mantysa = (wartosc >> (wykl - kBityMantysy)) & ((1u << kBityMantysy) - 1);
+    return kLiniowe + static_cast<size_t>(wykl - kBityMantysy - 1) * (size_t{1} << kBityMantysy) +
+           static_cast<size_t>(mantysa);
+  }
+
+  static uint64_t dolna_granica(size_t indeks) {
+    if (indeks < kLiniowe) {
+      return indeks;
+    }
+    size_t przesuniety = indeks - kLiniowe;
+    int wykl = static_cast<int>(przesuniety >> kBityMantysy) + kBityMantysy + 1;
+    uint64_t mantysa = przesuniety & ((size_t{1} << kBityMantysy) - 1);
+    return ((uint64_t{1} << kBityMantysy) | mantysa) << (wykl - kBityMantysy);
+  }
+
+  std::array<uint64_t, kLiczbaKubelkow> kubelki_{};
+  uint64_t liczba_ = 0;
+  uint64_t maksimum_ = 0;
+};
+
+struct Licznik {
+  alignas(64) std::atomic<uint64_t> wartosc{0};
+};
+
+struct WynikWatku {
+  HistogramOpoznien histogram;
+  Licznik wyslane_pokojowe;
+  Licznik wyslane_prywatne;
+  Licznik odebrane;
+  Licznik bledy;
+};
+
+struct WynikBurzy {
+  HistogramOpoznien histogram;
+  Licznik polaczone;
+  Licznik bledy;
+};
+
+struct PolaczenieTestowe {
+  UchwytGniazda gniazdo = kNieprawidloweGniazdo;
+  int id = 0;
+  std::string przychodzace;
+  std::string wychodzace;
+  Zegar::time_point nastepna_wysylka;
+  bool aktywne = false;
+};
+
+std::atomic<int> faza{static_cast<int>(Faza::Laczenie)};
+std::atomic<int> gotowe_watki{0};
+std::atomic<int64_t> poczatek_pomiaru_ns{0};
+std::atomic<bool> przerwano{false};
+
+void obsluz_sygnal(int) {
+  przerwano.store(true);
+}
+
+int64_t teraz_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Zegar::now().time_since_epoch())
+      .count();
+}
+
+void zamknij_gniazdo(UchwytGniazda gniazdo) {
+#ifdef _WIN32
+  closesocket(gniazdo);
+#else
+  close(gniazdo);
+#endif
+}
+
+bool czy_wstrzymane() {
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+void ustaw_nieblokujace(UchwytGniazda gniazdo) {
+#ifdef _WIN32
+  u_long tryb = 1;
+  ioctlsocket(gniazdo, FIONBIO, &tryb);
+#else
+  int flagi = fcntl(gniazdo, F_GETFL, 0);
+  fcntl(gniazdo, F_SETFL, flagi | O_NONBLOCK);
+#endif
+}
+
+int czekaj_na_zdarzenia(std::vector<pollfd>& deskryptory, int limit_ms) {
+#ifdef _WIN32
+  return WSAPoll(deskryptory.data(), static_cast<ULONG>(deskryptory.size()), limit_ms);
+#else
+  return poll(deskryptory.data(), deskryptory.size(), limit_ms);
+#endif
+}
+
+UchwytGniazda polacz(const sockaddr_in& adres) {
+  UchwytGniazda gniazdo = socket(AF_INET, SOCK_STREAM, 0);
+  if (gniazdo == kNieprawidloweGniazdo) {
+    return kNieprawidloweGniazdo;
+  }
+  if (connect(gniazdo, reinterpret_cast<const sockaddr*>(&adres), sizeof(adres)) != 0) {
+    zamknij_gniazdo(gniazdo);
+    return kNieprawidloweGniazdo;
+  }
+  ustaw_nieblokujace(gniazdo);
+  return gniazdo;
+}
+
+UchwytGniazda rozpocznij_laczenie(const sockaddr_in& adres) {
+  UchwytGniazda gniazdo = socket(AF_INET, SOCK_STREAM, 0);
+  if (gniazdo == kNieprawidloweGniazdo) {
+    return kNieprawidloweGniazdo;
+  }
+  ustaw_nieblokujace(gniazdo);
+  if (connect(gniazdo, reinterpret_cast<const sockaddr*>(&adres), sizeof(adres)) != 0) {
+#ifdef _WIN32
+    bool w_toku = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    bool w_toku = errno == EINPROGRESS;
+#endif
+    if (!w_toku) {
+      zamknij_gniazdo(gniazdo);
+      return kNieprawidloweGniazdo;
+    }
+  }
+  return gniazdo;
+}
+
+std::string nazwa_pokoju(const UstawieniaTestu& ustawienia, int id) {
+  return "stress" + std::to_string(id % ustawienia.pokoje);
+}
+
+std::string nazwa_uzytkownika(int id) {
+  return "stress_" + std::to_string(id);
+}
+
+bool oproznij(PolaczenieTestowe& polaczenie) {
+  while (!polaczenie.wychodzace.empty()) {
+    auto wyslano = send(polaczenie.gniazdo, polaczenie.wychodzace.data(),
+                        static_cast<int>(polaczenie.wychodzace.size()), kFlagiWysylania);
+    if (wyslano > 0) {
+      polaczenie.wychodzace.erase(0, static_cast<size_t>(wyslano));
+      continue;
+    }
+    return wyslano < 0 && czy_wstrzymane();
+  }
+  return true;
+}
+
+void zapisz_linie(std::string_view linia, int64_t odebrano_ns, WynikWatku& wynik) {
+  size_t pozycja = linia.find(kZnacznik);
+  if (pozycja == std::string_view::npos) {
+    return;
+  }
+  linia.remove_prefix(pozycja + kZnacznik.size());
+  int64_t wyslano_ns = 0;
+  for (char znak : linia) {
+    if (znak < '0' || znak > '9') {
+      break;
+    }
+    wyslano_ns = wyslano_ns * 10 + (znak - '0');
+  }
+  if (wyslano_ns <= 0 || wyslano_ns > odebrano_ns) {
+    return;
+  }
+  wynik.histogram.dodaj(static_cast<uint64_t>((odebrano_ns - wyslano_ns) / 1000));
+  wynik.odebrane.wartosc.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool odbierz(PolaczenieTestowe& polaczenie, std::vector<char>& bufor, WynikWatku& wynik) {
+  while (true) {
+    auto odebrano = recv(polaczenie.gniazdo, bufor.data(), static_cast<int>(bufor.size()), 0);
+    if (odebrano == 0) {
+      return false;
+    }
+    if (odebrano < 0) {
+      return czy_wstrzymane();
+    }
+    int64_t chwila = teraz_ns();
+    polaczenie.przychodzace.append(bufor.data(), static_cast<size_t>(odebrano));
+    size_t poczatek = 0;
+    size_t koniec_linii = polaczenie.przychodzace.find('\n');
+    while (koniec_linii != std::string::npos) {
+      zapisz_linie(std::string_view(polaczenie.przychodzace)
+                       .substr(poczatek, koniec_linii - poczatek),
+                   chwila, wynik);
+      poczatek = koniec_linii + 1;
+      koniec_linii = polaczenie.przychodzace.find('\n', poczatek);
+    }
+    polaczenie.przychodzace.erase(0, poczatek);
+  }
+}
+
+void zaplanuj(PolaczenieTestowe& polaczenie,
+              const UstawieniaTestu& ustawienia,
+              Zegar::time_point start,
+              std::mt19937& losowanie) {
+  if (ustawienia.synchronicznie || ustawienia.opoznienie_ms == 0) {
+    polaczenie.nastepna_wysylka = start;
+    return;
+  }
+  std::uniform_int_distribution<int> przesuniecie(0, ustawienia.opoznienie_ms * 1000);
+  polaczenie.nastepna_wysylka = start + std::chrono::microseconds(przesuniecie(losowanie));
+}
+
+void wyslij_wiadomosc(PolaczenieTestowe& polaczenie,
+                      const UstawieniaTestu& ustawienia,
+                      const std::string& wypelnienie,
+                      std::mt19937& losowanie,
+                      WynikWatku& wynik) {
+  std::uniform_int_distribution<int> procent(0, 99);
+  bool prywatna = ustawienia.polaczenia > 1 && procent(losowanie) < ustawienia.procent_prywatnych;
+  std::string& bufor = polaczenie.wychodzace;
+  if (prywatna) {
+    std::uniform_int_distribution<int> odbiorca(0, ustawienia.polaczenia - 2);
+    int id_odbiorcy = odbiorca(losowanie);
+    if (id_odbiorcy >= polaczenie.id) {
+      ++id_odbiorcy;
+    }
+    bufor += "/msg ";
+    bufor += nazwa_uzytkownika(id_odbiorcy);
+    bufor += ' ';
+    wynik.wyslane_prywatne.wartosc.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    wynik.wyslane_pokojowe.wartosc.fetch_add(1, std::memory_order_relaxed);
+  }
+  bufor += kZnacznik;
+  bufor += std::to_string(teraz_ns());
+  bufor += ' ';
+  bufor += wypelnienie;
+  bufor += '\n';
+}
+
+void watek_roboczy(int numer,
+                   int pierwsze_id,
+                   int liczba,
+                   const UstawieniaTestu& ustawienia,
+                   const sockaddr_in& adres,
+                   WynikWatku& wynik) {
+  std::vector<PolaczenieTestowe> polaczenia(static_cast<size_t>(liczba));
+  std::mt19937 losowanie(static_cast<unsigned>(numer * 7919 + 17));
+  std::string wypelnienie(static_cast<size_t>(ustawienia.rozmiar), 'x');
+  std::vector<char> bufor(64 * 1024);
+
+  for (int i = 0; i < liczba; ++i) {
+    PolaczenieTestowe& polaczenie = polaczenia[static_cast<size_t>(i)];
+    polaczenie.id = pierwsze_id + i;
+    polaczenie.gniazdo = polacz(adres);
+    if (polaczenie.gniazdo == kNieprawidloweGniazdo) {
+      wynik.bledy.wartosc.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    polaczenie.aktywne = true;
+    polaczenie.wychodzace = "/name " + nazwa_uzytkownika(polaczenie.id) + "\n";
+    if (polaczenie.id < ustawienia.pokoje) {
+      polaczenie.wychodzace += "/create " + nazwa_pokoju(ustawienia, polaczenie.id) + "\n";
+    }
+  }
+  gotowe_watki.fetch_add(1);
+
+  Faza obecna = Faza::Laczenie;
+  std::vector<pollfd> deskryptory;
+  std::vector<PolaczenieTestowe*> aktywne;
+  while (obecna != Faza::Koniec) {
+    Faza nowa = static_cast<Faza>(faza.load());
+    if (nowa != obecna) {
+      if (nowa == Faza::Dolaczanie) {
+        for (PolaczenieTestowe& polaczenie : polaczenia) {
+          if (polaczenie.aktywne && polaczenie.id >= ustawienia.pokoje) {
+            polaczenie.wychodzace += "/join " + nazwa_pokoju(ustawienia, polaczenie.id) + "\n";
+          }
+        }
+      } else if (nowa == Faza::Pomiar) {
+        Zegar::time_point start{std::chrono::nanoseconds(poczatek_pomiaru_ns.load())};
+        for (PolaczenieTestowe& polaczenie : polaczenia) {
+          zaplanuj(polaczenie, ustawienia, start, losowanie);
+        }
+      }
+      obecna = nowa;
+    }
+
+    Zegar::time_point teraz = Zegar::now();
+    Zegar::time_point najblizsza = teraz + std::chrono::milliseconds(10);
+    deskryptory.clear();
+    aktywne.clear();
+    for (PolaczenieTestowe& polaczenie : polaczenia) {
+      if (!polaczenie.aktywne) {
+        continue;
+      }
+      if (obecna == Faza::Pomiar) {
+        if (ustawienia.opoznienie_ms == 0) {
+          if (polaczenie.wychodzace.size() < 4096) {
+            wyslij_wiadomosc(polaczenie, ustawienia, wypelnienie, losowanie, wynik);
+          }
+        } else {
+          while (polaczenie.nastepna_wysylka <= teraz) {
+            wyslij_wiadomosc(polaczenie, ustawienia, wypelnienie, losowanie, wynik);
+            polaczenie.nastepna_wysylka += std::chrono::milliseconds(ustawienia.opoznienie_ms);
+          }
+          najblizsza = std::min(najblizsza, polaczenie.nastepna_wysylka);
+        }
+      }
+      if (!oproznij(polaczenie)) {
+        polaczenie.aktywne = false;
+        wynik.bledy.wartosc.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      pollfd deskryptor{};
+      deskryptor.fd = polaczenie.gniazdo;
+      deskryptor.events = POLLIN;
+      if (!polaczenie.wychodzace.empty()) {
+        deskryptor.events |= POLLOUT;
+      }
+      deskryptory.push_back(deskryptor);
+      aktywne.push_back(&polaczenie);
+    }
+
+    auto limit = std::chrono::duration_cast<std::chrono::milliseconds>(najblizsza - Zegar::now());
+    int limit_ms = static_cast<int>(std::max<int64_t>(0, limit.count()));
+    if (ustawienia.opoznienie_ms == 0 && obecna == Faza::Pomiar) {
+      limit_ms = 0;
+    }
+    if (deskryptory.empty()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    if (czekaj_na_zdarzenia(deskryptory, limit_ms) <= 0) {
+      continue;
+    }
+    for (size_t i = 0; i < deskryptory.size(); ++i) {
+      PolaczenieTestowe& polaczenie = *aktywne[i];
+      short zdarzenia = deskryptory[i].revents;
+      if ((zdarzenia & (POLLIN | POLLHUP | POLLERR)) && !odbierz(polaczenie, bufor, wynik)) {
+        polaczenie.aktywne = false;
+        wynik.bledy.wartosc.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  for (PolaczenieTestowe& polaczenie : polaczenia) {
+    if (polaczenie.gniazdo != kNieprawidloweGniazdo) {
+      zamknij_gniazdo(polaczenie.gniazdo);
+    }
+  }
+}
+
+void watek_burzy(int liczba,
+                 const sockaddr_in& adres,
+                 Zegar::time_point start,
+                 Zegar::time_point termin,
+                 WynikBurzy& wynik) {
+  std::this_thread::sleep_until(start);
+  std::vector<UchwytGniazda> gniazda;
+  std::vector<UchwytGniazda> oczekujace;
+  for (int i = 0; i < liczba; ++i) {
+    UchwytGniazda gniazdo = rozpocznij_laczenie(adres);
+    if (gniazdo == kNieprawidloweGniazdo) {
+      wynik.bledy.wartosc.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    gniazda.push_back(gniazdo);
+    oczekujace.push_back(gniazdo);
+  }
+
+  std::vector<pollfd> deskryptory;
+  char bufor[4096];
+  while (!oczekujace.empty() && !przerwano.load() && Zegar::now() < termin) {
+    deskryptory.clear();
+    for (UchwytGniazda gniazdo : oczekujace) {
+      pollfd deskryptor{};
+      deskryptor.fd = gniazdo;
+      deskryptor.events = POLLIN;
+      deskryptory.push_back(deskryptor);
+    }
+    if (czekaj_na_zdarzenia(deskryptory, 100) <= 0) {
+      continue;
+    }
+    int64_t chwila_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(Zegar::now() - start).count();
+    oczekujace.clear();
+    for (const pollfd& deskryptor : deskryptory) {
+      if (deskryptor.revents == 0) {
+        oczekujace.push_back(deskryptor.fd);
+        continue;
+      }
+      if ((deskryptor.revents & POLLIN) &&
+          recv(deskryptor.fd, bufor, static_cast<int>(sizeof(bufor)), 0) > 0) {
+        wynik.histogram.dodaj(static_cast<uint64_t>(std::max<int64_t>(chwila_us, 0)));
+        wynik.polaczone.wartosc.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        wynik.bledy.wartosc.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  wynik.bledy.wartosc.fetch_add(oczekujace.size(), std::memory_order_relaxed);
+
+  for (UchwytGniazda gniazdo : gniazda) {
+    zamknij_gniazdo(gniazdo);
+  }
+}
+
+bool odczytaj_liczbe(const std::string& tekst, int minimum, int* wynik) {
+  if (tekst.empty()) {
+    return false;
+  }
+  char* koniec = nullptr;
+  errno = 0;
+  long wartosc = std::strtol(tekst.c_str(), &koniec, 10);
+  if (errno != 0 || *koniec != '\0' || wartosc < minimum || wartosc > 1000000000) {
+    return false;
+  }
+  *wynik = static_cast<int>(wartosc);
+  return true;
+}
+
+bool wartosc_opcji(const std::string& argument, const std::string& nazwa, std::string* wartosc) {
+  if (argument.rfind(nazwa + "=", 0) != 0) {
+    return false;
+  }
+  *wartosc = argument.substr(nazwa.size() + 1);
+  return true;
+}
+
+bool parsuj_argumenty(int liczba_argumentow, char* argumenty[], UstawieniaTestu* ustawienia) {
+  int pozycyjne = 0;
+  for (int i = 1; i < liczba_argumentow; ++i) {
+    std::string argument = argumenty[i];
+    std::string wartosc;
+    if (argument == "--sync") {
+      ustawienia->synchronicznie = true;
+    } else if (wartosc_opcji(argument, "--connections", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &ustawienia->polaczenia)) {
+        std::cerr << "Nieprawidłowa liczba połączeń: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--rooms", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &ustawienia->pokoje)) {
+        std::cerr << "Nieprawidłowa liczba pokoi: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--private", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &ustawienia->procent_prywatnych) ||
+          ustawienia->procent_prywatnych > 100) {
+        std::cerr << "Nieprawidłowy odsetek wiadomości prywatnych: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--storm", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 1, &ustawienia->rundy_burzy)) {
+        std::cerr << "Nieprawidłowa liczba rund burzy połączeń: " << wartosc << "\n";
+        return false;
+      }
+    } else if (wartosc_opcji(argument, "--size", &wartosc)) {
+      if (!odczytaj_liczbe(wartosc, 0, &ustawienia->rozmiar)) {
+        std::cerr << "Nieprawidłowy rozmiar wiadomości: " << wartosc << "\n";
+        return false;
+      }
+    } else if (argument.rfind("--", 0) == 0) {
+      std::cerr << "Nieznana opcja: " << argument << "\n";
+      return false;
+    } else {
+      bool poprawny = true;
+      switch (pozycyjne) {
+        case 0:
+          ustawienia->host = argument;
+          break;
+        case 1:
+          poprawny = odczytaj_liczbe(argument, 1, &ustawienia->port) && ustawienia->port <= 65535;
+          break;
+        case 2:
+          poprawny = odczytaj_liczbe(argument, 1, &ustawienia->watki);
+          break;
+        case 3:
+          poprawny = odczytaj_liczbe(argument, 0, &ustawienia->opoznienie_ms);
+          break;
+        case 4:
+          poprawny = odczytaj_liczbe(argument, 0, &ustawienia->czas_s);
+          break;
+        default:
+          poprawny = false;
+      }
+      if (!poprawny) {
+        std::cerr << "Nieprawidłowy argument: " << argument << "\n";
+        return false;
+      }
+      ++pozycyjne;
+    }
+  }
+  if (ustawienia->polaczenia == 0) {
+    ustawienia->polaczenia = ustawienia->watki;
+  }
+  ustawienia->watki = std::min(ustawienia->watki, ustawienia->polaczenia);
+  ustawienia->pokoje = std::min(ustawienia->pokoje, ustawienia->polaczenia);
+  return true;
+}
+
+bool rozwiaz_adres(const UstawieniaTestu& ustawienia, sockaddr_in* adres) {
+  addrinfo wskazowki{};
+  wskazowki.ai_family = AF_INET;
+  wskazowki.ai_socktype = SOCK_STREAM;
+  addrinfo* wynik = nullptr;
+  if (getaddrinfo(ustawienia.host.c_str(), nullptr, &wskazowki, &wynik) != 0 || wynik == nullptr) {
+    return false;
+  }
+  *adres = *reinterpret_cast<sockaddr_in*>(wynik->ai_addr);
+  adres->sin_port = htons(static_cast<uint16_t>(ustawienia.port));
+  freeaddrinfo(wynik);
+  return true;
+}
+
+#ifndef _WIN32
+void podnies_limit_deskryptorow() {
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+#endif
+
+template <typename Wynik>
+uint64_t suma(const std::vector<Wynik>& wyniki, Licznik Wynik::*pole) {
+  uint64_t wynik = 0;
+  for (const Wynik& w : wyniki) {
+    wynik += (w.*pole).wartosc.load(std::memory_order_relaxed);
+  }
+  return wynik;
+}
+
+int test_burzy(const UstawieniaTestu& ustawienia, const sockaddr_in& adres) {
+  constexpr auto kLimitRundy = std::chrono::seconds(30);
+  std::cout << std::fixed << std::setprecision(1);
+  std::vector<double> czasy_ms;
+  for (int runda = 1; runda <= ustawienia.rundy_burzy && !przerwano.load(); ++runda) {
+    std::vector<WynikBurzy> wyniki(static_cast<size_t>(ustawienia.watki));
+    std::vector<std::thread> watki;
+    Zegar::time_point start = Zegar::now() + std::chrono::milliseconds(50);
+    int na_watek = ustawienia.polaczenia / ustawienia.watki;
+    int nadmiar = ustawienia.polaczenia % ustawienia.watki;
+    for (int i = 0; i < ustawienia.watki; ++i) {
+      watki.emplace_back(watek_burzy, na_watek + (i < nadmiar ? 1 : 0), std::cref(adres), start,
+                         start + kLimitRundy, std::ref(wyniki[static_cast<size_t>(i)]));
+    }
+    for (std::thread& watek : watki) {
+      watek.join();
+    }
+
+    HistogramOpoznien histogram;
+    for (const WynikBurzy& wynik : wyniki) {
+      histogram.scal(wynik.histogram);
+    }
+    uint64_t polaczone = suma(wyniki, &WynikBurzy::polaczone);
+    double wszystkie_ms = static_cast<double>(histogram.maksimum()) / 1000.0;
+    std::cout << "Runda " << runda << ": połączono " << polaczone << "/" << ustawienia.polaczenia
+              << " w " << wszystkie_ms << " ms (p50=" << histogram.percentyl(50.0) / 1000.0
+              << " ms, p99=" << histogram.percentyl(99.0) / 1000.0
+              << " ms), błędy: " << suma(wyniki, &WynikBurzy::bledy) << "\n";
+    if (polaczone == static_cast<uint64_t>(ustawienia.polaczenia)) {
+      czasy_ms.push_back(wszystkie_ms);
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+
+  if (czasy_ms.empty()) {
+    std::cout << "Żadna runda nie połączyła wszystkich klientów.\n";
+    return 1;
+  }
+  std::sort(czasy_ms.begin(), czasy_ms.end());
+  std::cout << "Czas do połączenia wszystkich [ms]: min=" << czasy_ms.front()
+            << " mediana=" << czasy_ms[czasy_ms.size() / 2] << " max=" << czasy_ms.back()
+            << " (pełne rundy: " << czasy_ms.size() << "/" << ustawienia.rundy_burzy << ")\n";
+  return 0;
+}
+}  // namespace
+
+int main(int liczba_argumentow, char* argumenty[]) {
+  UstawieniaTestu ustawienia;
+  if (!parsuj_argumenty(liczba_argumentow, argumenty, &ustawienia)) {
+    std::cerr << "Użycie: " << argumenty[0]
+              << " [host] [port] [wątki] [opóźnienie_ms] [czas_s] [--sync] [--connections=N]"
+                 " [--rooms=N] [--private=PROCENT] [--size=BAJTY] [--storm=RUNDY]\n";
+    return 1;
+  }
+
+#ifdef _WIN32
+  WSADATA dane_wsa;
+  if (WSAStartup(MAKEWORD(2, 2), &dane_wsa) != 0) {
+    std::cerr << "WSAStartup failed\n";
+    return 1;
+  }
+#else
+  std::signal(SIGPIPE, SIG_IGN);
+  podnies_limit_deskryptorow();
+#endif
+  std::signal(SIGINT, obsluz_sygnal);
+
+  sockaddr_in adres{};
+  if (!rozwiaz_adres(ustawienia, &adres)) {
+    std::cerr << "Nie można rozwiązać adresu: " << ustawienia.host << "\n";
+    return 1;
+  }
+
+  if (ustawienia.rundy_burzy > 0) {
+    int kod = test_burzy(ustawienia, adres);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return kod;
+  }
+
+  std::vector<WynikWatku> wyniki(static_cast<size_t>(ustawienia.watki));
+  std::vector<std::thread> watki;
+  int na_watek = ustawienia.polaczenia / ustawienia.watki;
+  int nadmiar = ustawienia.polaczenia % ustawienia.watki;
+  int pierwsze_id = 0;
+  for (int i = 0; i < ustawienia.watki; ++i) {
+    int liczba = na_watek + (i < nadmiar ? 1 : 0);
+    watki.emplace_back(watek_roboczy, i, pierwsze_id, liczba, std::cref(ustawienia),
+                       std::cref(adres), std::ref(wyniki[static_cast<size_t>(i)]));
+    pierwsze_id += liczba;
+  }
+
+  while (gotowe_watki.load() < ustawienia.watki) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  uint64_t bledy_polaczen = suma(wyniki, &WynikWatku::bledy);
+  std::cout << "Połączono " << ustawienia.polaczenia - static_cast<int>(bledy_polaczen) << "/"
+            << ustawienia.polaczenia << " klientów w " << ustawienia.watki << " wątkach.\n";
+
+  faza.store(static_cast<int>(Faza::Dolaczanie));
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  poczatek_pomiaru_ns.store(teraz_ns());
+  Zegar::time_point start = Zegar::now();
+  faza.store(static_cast<int>(Faza::Pomiar));
+
+  uint64_t poprzednio_odebrane = 0;
+  int sekunda = 0;
+  while (!przerwano.load() && (ustawienia.czas_s == 0 || sekunda < ustawienia.czas_s)) {
+    std::this_thread::sleep_until(start + std::chrono::seconds(sekunda + 1));
+    ++sekunda;
+    uint64_t odebrane = suma(wyniki, &WynikWatku::odebrane);
+    std::cout << "[" << sekunda << "s] wysłane="
+              << suma(wyniki, &WynikWatku::wyslane_pokojowe) +
+                     suma(wyniki, &WynikWatku::wyslane_prywatne)
+              << " odebrane=" << odebrane << " (+" << odebrane - poprzednio_odebrane << "/s)\n";
+    poprzednio_odebrane = odebrane;
+  }
+  double czas_pomiaru =
+      std::chrono::duration<double>(Zegar::now() - start).count();
+
+  faza.store(static_cast<int>(Faza::Oproznianie));
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  faza.store(static_cast<int>(Faza::Koniec));
+  for (std::thread& watek : watki) {
+    watek.join();
+  }
+
+  HistogramOpoznien histogram;
+  for (const WynikWatku& wynik : wyniki) {
+    histogram.scal(wynik.histogram);
+  }
+  uint64_t pokojowe = suma(wyniki, &WynikWatku::wyslane_pokojowe);
+  uint64_t prywatne = suma(wyniki, &WynikWatku::wyslane_prywatne);
+  uint64_t odebrane = suma(wyniki, &WynikWatku::odebrane);
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Czas pomiaru: " << czas_pomiaru << " s\n";
+  std::cout << "Wysłane: " << pokojowe + prywatne << " (pokojowe " << pokojowe << ", prywatne "
+            << prywatne << "), " << static_cast<double>(pokojowe + prywatne) / czas_pomiaru
+            << " msg/s\n";
+  std::cout << "Dostarczone: " << odebrane << ", " << static_cast<double>(odebrane) / czas_pomiaru
+            << " msg/s\n";
+  std::cout << "Opóźnienie [us]: p50=" << histogram.percentyl(50.0)
+            << " p99=" << histogram.percentyl(99.0) << " p999=" << histogram.percentyl(99.9)
+            << " max=" << histogram.maksimum() << "\n";
+  std::cout << "Błędy połączeń: " << suma(wyniki, &WynikWatku::bledy) << "\n";
+
+#ifdef _WIN32
+  WSACleanup();
+#endif
+  return 0;
+}
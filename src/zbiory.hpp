@@ -0,0 +1,57 @@
+#ifndef CHATAPP_ZBIORY_HPP
+#define CHATAPP_ZBIORY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace zbiory {
+
+template <typename Element>
+class ZbiorPosortowany {
+ public:
+  using const_iterator = typename std::vector<Element>::const_iterator;
+
+  bool wstaw(const Element& element) {
+    auto miejsce = std::lower_bound(elementy_.begin(), elementy_.end(), element);
+    if (miejsce != elementy_.end() && *miejsce == element) {
+      return false;
+    }
+    elementy_.insert(miejsce, element);
+    return true;
+  }
+
+  bool usun(const Element& element) {
+    auto miejsce = std::lower_bound(elementy_.begin(), elementy_.end(), element);
+    if (miejsce == elementy_.end() || *miejsce != element) {
+      return false;
+    }
+    elementy_.erase(miejsce);
+    if (elementy_.capacity() > 2 * elementy_.size() + 16) {
+      elementy_.shrink_to_fit();
+    }
+    return true;
+  }
+
+  bool zawiera(const Element& element) const {
+    return std::binary_search(elementy_.begin(), elementy_.end(), element);
+  }
+
+  void wyczysc() {
+    elementy_.clear();
+    elementy_.shrink_to_fit();
+  }
+
+  size_t rozmiar() const { return elementy_.size(); }
+  bool pusty() const { return elementy_.empty(); }
+  const std::vector<Element>& elementy() const { return elementy_; }
+  const_iterator begin() const { return elementy_.begin(); }
+  const_iterator end() const { return elementy_.end(); }
+
+ private:
+  std::vector<Element> elementy_;
+};
+
+}  // namespace zbiory
+
+#endif